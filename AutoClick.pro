@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui xml
+QT       += core gui
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -12,23 +12,27 @@ TARGET = AutoClick
 TEMPLATE = app
 CONFIG += c++11
 
+include(AutoClickEngine.pri)
+
 SOURCES += main.cpp \
     MainWindow.cpp \
-    MouseRobot.cpp \
     MouseRule.cpp \
+    MouseRuleDelegate.cpp \
+    MouseRuleModel.cpp \
+    MouseRuleOverlay.cpp \
     SizedLineEdit.cpp \
     GlassWindow.cpp \
-    LimitedKeySequence.cpp \
-    MouseRuleConfig.cpp
+    LimitedKeySequence.cpp
 
 HEADERS  += \
     MainWindow.hpp \
-    MouseRobot.hpp \
     MouseRule.hpp \
+    MouseRuleDelegate.hpp \
+    MouseRuleModel.hpp \
+    MouseRuleOverlay.hpp \
     SizedLineEdit.hpp \
     GlassWindow.hpp \
-    LimitedKeySequence.hpp \
-    MouseRuleConfig.hpp
+    LimitedKeySequence.hpp
 
 FORMS    += \
     MainWindow.ui \
@@ -39,8 +43,6 @@ FORMS    += \
 RESOURCES += \
     icons.qrc
 
-LIBS += -lX11 -lXtst
-
 LIBS += -L$$PWD/../build-uglobalhotkey-Desktop_Qt_5_7_0_GCC_64bit-Debug/ -lUGlobalHotkey
 INCLUDEPATH += $$PWD/../GlobalHotkey
 DEPENDPATH += $$PWD/../GlobalHotkey
@@ -0,0 +1,25 @@
+#-------------------------------------------------
+#
+# QTest benchmarks: engine, injection submission, rule files and overlay painting
+#
+#-------------------------------------------------
+
+QT       += core gui widgets testlib
+
+TARGET = autoclick-bench
+TEMPLATE = app
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+include(AutoClickEngine.pri)
+
+SOURCES += main_bench.cpp \
+    GlassWindow.cpp \
+    MouseRuleOverlay.cpp
+
+HEADERS += \
+    GlassWindow.hpp \
+    MouseRuleOverlay.hpp
+
+RESOURCES += \
+    icons.qrc
@@ -0,0 +1,43 @@
+# Widget-free rule engine shared by the GUI and the headless runner
+
+QT += core
+
+CONFIG += c++11
+
+SOURCES += \
+    $$PWD/BinaryRuleFile.cpp \
+    $$PWD/FireHistogram.cpp \
+    $$PWD/MouseRobot.cpp \
+    $$PWD/MouseRobotBackend.cpp \
+    $$PWD/MouseRuleConfig.cpp \
+    $$PWD/MouseRuleData.cpp \
+    $$PWD/NullBackend.cpp \
+    $$PWD/PixelSampler.cpp \
+    $$PWD/RecordingBackend.cpp \
+    $$PWD/RuleFileWatcher.cpp \
+    $$PWD/RuleJournal.cpp \
+    $$PWD/RuleScheduler.cpp \
+    $$PWD/ThreadSettings.cpp \
+    $$PWD/XcbBackend.cpp \
+    $$PWD/XlibBackend.cpp
+
+HEADERS += \
+    $$PWD/BinaryRuleFile.hpp \
+    $$PWD/FireHistogram.hpp \
+    $$PWD/MouseRobot.hpp \
+    $$PWD/MouseRobotBackend.hpp \
+    $$PWD/MouseRuleConfig.hpp \
+    $$PWD/MouseRuleData.hpp \
+    $$PWD/NullBackend.hpp \
+    $$PWD/PixelSampler.hpp \
+    $$PWD/RecordingBackend.hpp \
+    $$PWD/RuleFileWatcher.hpp \
+    $$PWD/RuleJournal.hpp \
+    $$PWD/RuleScheduler.hpp \
+    $$PWD/ThreadSettings.hpp \
+    $$PWD/XcbBackend.hpp \
+    $$PWD/XlibBackend.hpp
+
+INCLUDEPATH += $$PWD
+
+LIBS += -lX11 -lXext -lXtst -lXi -lxcb -lxcb-xtest -lxcb-xinput
@@ -0,0 +1,16 @@
+#-------------------------------------------------
+#
+# Latency harness: deadline to received event on a private Xvfb
+#
+#-------------------------------------------------
+
+QT       = core
+
+TARGET = autoclick-latency
+TEMPLATE = app
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+include(AutoClickEngine.pri)
+
+SOURCES += main_latency.cpp
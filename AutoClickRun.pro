@@ -0,0 +1,16 @@
+#-------------------------------------------------
+#
+# Headless runner: executes a rule file without any widgets
+#
+#-------------------------------------------------
+
+QT       = core
+
+TARGET = autoclick-run
+TEMPLATE = app
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+include(AutoClickEngine.pri)
+
+SOURCES += main_run.cpp
@@ -0,0 +1,338 @@
+#include "BinaryRuleFile.hpp"
+#include <QSaveFile>
+#include <QtEndian>
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+
+namespace
+{
+    const char Magic[4] = { 'A', 'C', 'R', 'B' };
+    const char Suffix[] = ".acr";
+
+    // All fields little-endian. Later versions may append fields to both
+    // structs, readers step by the sizes stored in the header.
+    struct Header
+    {
+        char magic[4];
+        quint32 version;
+        quint32 headerSize;
+        // CRC-32 of everything after this field up to the end of the file
+        quint32 checksum;
+        quint32 recordSize;
+        quint32 ruleCount;
+        quint32 catchUpPolicy;
+        quint32 motionPath;
+        quint32 motionRate;
+        // Thread settings of older files, now written as 0 and ignored
+        qint32 realtimePriority;
+        qint64 motionDuration;
+        quint64 cpuMask;
+        quint32 isMemoryLocked;
+        quint32 reserved[3];
+    };
+    static_assert(sizeof(Header) == 72, "binary rule header layout");
+
+    const qint64 ChecksumEnd = offsetof(Header, checksum) + sizeof(quint32);
+
+    struct RuleRecord
+    {
+        qint32 x;
+        qint32 y;
+        quint32 positionMode;
+        quint32 intervalMode;
+        quint32 actionMode;
+        quint32 action;
+        qint64 interval;
+        quint32 burstRate;
+        // Bit 0: pixel condition enabled
+        quint32 flags;
+        qint64 burstDuration;
+        // Appended to the first 48 byte records, missing in older files
+        qint32 pixelX;
+        qint32 pixelY;
+        quint32 pixelColor;
+        quint32 pixelTolerance;
+    };
+    static_assert(sizeof(RuleRecord) == 64, "binary rule record layout");
+
+    const quint32 MinimumRecordSize = 48;
+    const quint32 ConditionFlag = 1u;
+
+
+    std::array<quint32, 256> makeCrcTable()
+    {
+        std::array<quint32, 256> table;
+        for (quint32 i = 0; i < 256; ++i)
+        {
+            quint32 c = i;
+            for (int k = 0; k < 8; ++k)
+            {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        return table;
+    }
+
+
+    quint32 crc32(const uchar *data, qint64 size)
+    {
+        static const std::array<quint32, 256> table = makeCrcTable();
+        quint32 crc = 0xFFFFFFFFu;
+        for (qint64 i = 0; i < size; ++i)
+        {
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return crc ^ 0xFFFFFFFFu;
+    }
+
+
+    template <typename T>
+    T le(T value)
+    {
+        return qFromLittleEndian(value);
+    }
+
+
+    // Values of a newer writer fall back to the default
+    template <typename E>
+    E toEnum(quint32 value, E last, E fallback)
+    {
+        return value <= quint32(last) ? E(value) : fallback;
+    }
+
+
+    Header readHeader(const uchar *data)
+    {
+        Header header;
+        memcpy(&header, data, sizeof(header));
+        return header;
+    }
+}
+
+
+BinaryRuleFile::BinaryRuleFile(const QString &fileName)
+    : mFile(fileName)
+    , mBytes()
+    , mData(0)
+    , mSize(0)
+    , mHeaderSize(0)
+    , mRecordSize(0)
+    , mRuleCount(0)
+    , mErrorString()
+{
+}
+
+
+BinaryRuleFile::BinaryRuleFile(const QByteArray &data)
+    : mFile()
+    , mBytes(data)
+    , mData(0)
+    , mSize(0)
+    , mHeaderSize(0)
+    , mRecordSize(0)
+    , mRuleCount(0)
+    , mErrorString()
+{
+}
+
+
+bool BinaryRuleFile::open()
+{
+    if (mFile.fileName().isEmpty())
+    {
+        // Read in place from the data given to the constructor
+        mSize = mBytes.size();
+        mData = reinterpret_cast<const uchar*>(mBytes.constData());
+        return validate();
+    }
+    if (!mFile.open(QIODevice::ReadOnly))
+    {
+        return fail(mFile.errorString());
+    }
+    mSize = mFile.size();
+    if (mSize < qint64(sizeof(Header)))
+    {
+        return fail("file too short");
+    }
+    mData = mFile.map(0, mSize);
+    if (!mData)
+    {
+        return fail(mFile.errorString());
+    }
+    return validate();
+}
+
+
+bool BinaryRuleFile::validate()
+{
+    if (mSize < qint64(sizeof(Header)))
+    {
+        return fail("file too short");
+    }
+    Header header = readHeader(mData);
+    if (memcmp(header.magic, Magic, sizeof(Magic)) != 0)
+    {
+        return fail("not a binary rule file");
+    }
+    if (le(header.version) != Version)
+    {
+        return fail(QString("unsupported version %1").arg(int(le(header.version))));
+    }
+    mHeaderSize = le(header.headerSize);
+    mRecordSize = le(header.recordSize);
+    quint32 ruleCount = le(header.ruleCount);
+    if (mHeaderSize < sizeof(Header) || mRecordSize < MinimumRecordSize || ruleCount > quint32(INT_MAX)
+        || mSize != qint64(mHeaderSize) + qint64(mRecordSize) * ruleCount)
+    {
+        return fail("invalid header");
+    }
+    if (crc32(mData + ChecksumEnd, mSize - ChecksumEnd) != le(header.checksum))
+    {
+        return fail("checksum mismatch");
+    }
+    mRuleCount = int(ruleCount);
+    return true;
+}
+
+
+QString BinaryRuleFile::errorString() const
+{
+    return mErrorString;
+}
+
+
+MouseRuleSettings BinaryRuleFile::settings() const
+{
+    MouseRuleSettings settings;
+    Header header = readHeader(mData);
+    settings.catchUpPolicy = toEnum(le(header.catchUpPolicy), CoalesceCatchUp, settings.catchUpPolicy);
+    settings.motion.path = toEnum(le(header.motionPath), MouseRobot::BezierMotion, settings.motion.path);
+    settings.motion.rate = le(header.motionRate);
+    settings.motion.duration = le(header.motionDuration);
+    if (header.realtimePriority != 0 || header.isMemoryLocked != 0 || header.cpuMask != 0)
+    {
+        qWarning("BinaryRuleFile: ignoring thread settings, use --realtime, --lock-memory or --cpus");
+    }
+    return settings;
+}
+
+
+int BinaryRuleFile::ruleCount() const
+{
+    return mRuleCount;
+}
+
+
+MouseRuleData BinaryRuleFile::rule(int index) const
+{
+    RuleRecord record;
+    memset(&record, 0, sizeof(record));
+    memcpy(&record, mData + mHeaderSize + qint64(mRecordSize) * index, std::min<size_t>(mRecordSize, sizeof(record)));
+    PixelCondition condition((le(record.flags) & ConditionFlag) != 0, QPoint(le(record.pixelX), le(record.pixelY)),
+                             le(record.pixelColor), le(record.pixelTolerance));
+    return MouseRuleData(QPoint(le(record.x), le(record.y)),
+                         toEnum(le(record.positionMode), RelativePosition, CurrentPosition),
+                         le(record.interval),
+                         toEnum(le(record.intervalMode), MicrosecondsInterval, MillisecondsInterval),
+                         le(record.action),
+                         toEnum(le(record.actionMode), BurstAction, NoAction),
+                         le(record.burstRate),
+                         le(record.burstDuration),
+                         condition);
+}
+
+
+bool BinaryRuleFile::isBinary(const QString &fileName)
+{
+    QFile file(fileName);
+    char magic[sizeof(Magic)];
+    return file.open(QIODevice::ReadOnly)
+        && file.read(magic, sizeof(magic)) == qint64(sizeof(magic))
+        && memcmp(magic, Magic, sizeof(Magic)) == 0;
+}
+
+
+bool BinaryRuleFile::isBinaryData(const QByteArray &data)
+{
+    return data.size() >= int(sizeof(Magic)) && memcmp(data.constData(), Magic, sizeof(Magic)) == 0;
+}
+
+
+bool BinaryRuleFile::isBinaryName(const QString &fileName)
+{
+    return fileName.endsWith(QLatin1String(Suffix), Qt::CaseInsensitive);
+}
+
+
+bool BinaryRuleFile::write(const QString &fileName, const MouseRuleSettings &settings, const MouseRules &rules, QString *errorString)
+{
+    QByteArray data(int(sizeof(Header) + sizeof(RuleRecord) * rules.size()), 0);
+    uchar *out = reinterpret_cast<uchar*>(data.data());
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = qToLittleEndian(quint32(Version));
+    header.headerSize = qToLittleEndian(quint32(sizeof(Header)));
+    header.recordSize = qToLittleEndian(quint32(sizeof(RuleRecord)));
+    header.ruleCount = qToLittleEndian(quint32(rules.size()));
+    header.catchUpPolicy = qToLittleEndian(quint32(settings.catchUpPolicy));
+    header.motionPath = qToLittleEndian(quint32(settings.motion.path));
+    header.motionRate = qToLittleEndian(settings.motion.rate);
+    header.motionDuration = qToLittleEndian(settings.motion.duration);
+
+    uchar *records = out + sizeof(Header);
+    for (MouseRules::const_iterator i = rules.begin(); i != rules.end(); ++i)
+    {
+        RuleRecord record;
+        memset(&record, 0, sizeof(record));
+        record.x = qToLittleEndian(qint32(i->position.x()));
+        record.y = qToLittleEndian(qint32(i->position.y()));
+        record.positionMode = qToLittleEndian(quint32(i->positionMode));
+        record.intervalMode = qToLittleEndian(quint32(i->intervalMode));
+        record.actionMode = qToLittleEndian(quint32(i->actionMode));
+        record.action = qToLittleEndian(i->action);
+        record.interval = qToLittleEndian(i->interval);
+        record.burstRate = qToLittleEndian(i->burstRate);
+        record.burstDuration = qToLittleEndian(i->burstDuration);
+        record.flags = qToLittleEndian(i->condition.isEnabled ? ConditionFlag : 0u);
+        record.pixelX = qToLittleEndian(qint32(i->condition.position.x()));
+        record.pixelY = qToLittleEndian(qint32(i->condition.position.y()));
+        record.pixelColor = qToLittleEndian(i->condition.color);
+        record.pixelTolerance = qToLittleEndian(i->condition.tolerance);
+        memcpy(records, &record, sizeof(record));
+        records += sizeof(record);
+    }
+    memcpy(out, &header, sizeof(header));
+    quint32 checksum = qToLittleEndian(crc32(out + ChecksumEnd, data.size() - ChecksumEnd));
+    memcpy(out + offsetof(Header, checksum), &checksum, sizeof(checksum));
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit())
+    {
+        if (errorString)
+        {
+            *errorString = file.errorString();
+        }
+        return false;
+    }
+    return true;
+}
+
+
+quint32 BinaryRuleFile::checksum(const uchar *data, qint64 size)
+{
+    return crc32(data, size);
+}
+
+
+bool BinaryRuleFile::fail(const QString &errorString)
+{
+    mErrorString = errorString;
+    mRuleCount = 0;
+    return false;
+}
@@ -0,0 +1,55 @@
+#ifndef BINARYRULEFILE_HPP
+#define BINARYRULEFILE_HPP
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include "MouseRuleConfig.hpp"
+
+
+// Binary rule file: a little-endian header followed by fixed-size rule
+// records. The file is memory mapped and records are read in place, so
+// loading needs no parsing beyond the checksum.
+class BinaryRuleFile
+{
+public:
+    enum
+    {
+        Version = 1
+    };
+
+    explicit BinaryRuleFile(const QString &fileName);
+    // Reads the rules from a file already read into memory
+    explicit BinaryRuleFile(const QByteArray &data);
+
+    // Maps the file and validates header, size and checksum
+    bool open();
+    QString errorString() const;
+    MouseRuleSettings settings() const;
+    int ruleCount() const;
+    MouseRuleData rule(int index) const;
+
+    // True if the file starts with the binary magic
+    static bool isBinary(const QString &fileName);
+    static bool isBinaryData(const QByteArray &data);
+    // True if a file of this name is saved in binary (*.acr)
+    static bool isBinaryName(const QString &fileName);
+    static bool write(const QString &fileName, const MouseRuleSettings &settings, const MouseRules &rules, QString *errorString = 0);
+    // CRC-32 as used for the file checksum
+    static quint32 checksum(const uchar *data, qint64 size);
+
+private:
+    bool fail(const QString &errorString);
+    bool validate();
+
+    QFile mFile;
+    QByteArray mBytes;
+    const uchar *mData;
+    qint64 mSize;
+    quint32 mHeaderSize;
+    quint32 mRecordSize;
+    int mRuleCount;
+    QString mErrorString;
+};
+
+#endif // BINARYRULEFILE_HPP
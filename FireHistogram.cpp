@@ -0,0 +1,159 @@
+#include "FireHistogram.hpp"
+#include <QTextStream>
+#include <algorithm>
+#include <cmath>
+
+
+FireHistogram::FireHistogram()
+    : mCount(0)
+    , mMissed(0)
+    , mMaximum(0)
+    , mSum(0.0)
+    , mSumSquares(0.0)
+{
+    for (int i = 0; i < BucketCount; ++i)
+    {
+        mCounts[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+
+void FireHistogram::record(qint64 lateness)
+{
+    lateness = std::max<qint64>(lateness, 0);
+    mCounts[bucketOf(lateness / 1000)].fetch_add(1, std::memory_order_relaxed);
+    if (lateness > MissTolerance)
+    {
+        mMissed.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (lateness > mMaximum.load(std::memory_order_relaxed))
+    {
+        mMaximum.store(lateness, std::memory_order_relaxed);
+    }
+    double value = static_cast<double>(lateness);
+    mSum.store(mSum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    mSumSquares.store(mSumSquares.load(std::memory_order_relaxed) + value * value, std::memory_order_relaxed);
+    // Last, so readers never see more fires than bucket entries
+    mCount.fetch_add(1, std::memory_order_release);
+}
+
+
+void FireHistogram::skip(quint64 deadlines)
+{
+    mMissed.fetch_add(deadlines, std::memory_order_relaxed);
+}
+
+
+void FireHistogram::reset()
+{
+    mCount.store(0, std::memory_order_relaxed);
+    mMissed.store(0, std::memory_order_relaxed);
+    mMaximum.store(0, std::memory_order_relaxed);
+    mSum.store(0.0, std::memory_order_relaxed);
+    mSumSquares.store(0.0, std::memory_order_relaxed);
+    for (int i = 0; i < BucketCount; ++i)
+    {
+        mCounts[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+
+quint64 FireHistogram::count() const
+{
+    return mCount.load(std::memory_order_acquire);
+}
+
+
+quint64 FireHistogram::missed() const
+{
+    return mMissed.load(std::memory_order_relaxed);
+}
+
+
+qint64 FireHistogram::percentile(qreal fraction) const
+{
+    quint64 total = count();
+    if (total == 0)
+    {
+        return 0;
+    }
+    quint64 rank = std::max<quint64>(1, static_cast<quint64>(fraction * total + 0.5));
+    quint64 sum = 0;
+    for (int i = 0; i < BucketCount; ++i)
+    {
+        sum += mCounts[i].load(std::memory_order_relaxed);
+        if (sum >= rank)
+        {
+            return std::min(static_cast<qint64>(upperBoundOf(i)) * 1000, maximum());
+        }
+    }
+    return maximum();
+}
+
+
+qint64 FireHistogram::maximum() const
+{
+    return mMaximum.load(std::memory_order_relaxed);
+}
+
+
+qint64 FireHistogram::mean() const
+{
+    quint64 n = count();
+    return n > 0 ? static_cast<qint64>(mSum.load(std::memory_order_relaxed) / n) : 0;
+}
+
+
+qint64 FireHistogram::jitter() const
+{
+    quint64 n = count();
+    if (n == 0)
+    {
+        return 0;
+    }
+    double mean = mSum.load(std::memory_order_relaxed) / n;
+    double variance = mSumSquares.load(std::memory_order_relaxed) / n - mean * mean;
+    return static_cast<qint64>(std::sqrt(std::max(variance, 0.0)));
+}
+
+
+void FireHistogram::write(QTextStream &stream) const
+{
+    stream << "count " << count() << " missed " << missed()
+           << " p50_us " << percentile(0.5) / 1000 << " p99_us " << percentile(0.99) / 1000
+           << " max_us " << maximum() / 1000 << " jitter_us " << jitter() / 1000 << "\n";
+    for (int i = 0; i < BucketCount; ++i)
+    {
+        quint64 n = mCounts[i].load(std::memory_order_relaxed);
+        if (n > 0)
+        {
+            stream << upperBoundOf(i) << " " << n << "\n";
+        }
+    }
+}
+
+
+int FireHistogram::bucketOf(quint64 micros)
+{
+    // Values below the sub-bucket count are exact, above that each power of
+    // two is split into SubBucketCount linear buckets
+    if (micros < SubBucketCount)
+    {
+        return static_cast<int>(micros);
+    }
+    int exponent = 63 - __builtin_clzll(micros);
+    int sub = static_cast<int>(micros >> (exponent - SubBucketBits)) & (SubBucketCount - 1);
+    return std::min((exponent - SubBucketBits + 1) * SubBucketCount + sub, static_cast<int>(BucketCount) - 1);
+}
+
+
+quint64 FireHistogram::upperBoundOf(int bucket)
+{
+    if (bucket < SubBucketCount)
+    {
+        return bucket;
+    }
+    int exponent = bucket / SubBucketCount + SubBucketBits - 1;
+    quint64 sub = bucket % SubBucketCount;
+    return ((SubBucketCount + sub + 1) << (exponent - SubBucketBits)) - 1;
+}
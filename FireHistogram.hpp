@@ -0,0 +1,60 @@
+#ifndef FIREHISTOGRAM_HPP
+#define FIREHISTOGRAM_HPP
+
+#include <QtGlobal>
+#include <atomic>
+class QTextStream;
+
+
+// Lateness of a rule's fires against their planned deadlines. Buckets are
+// log-linear in microseconds (16 per power of two, about 6% resolution), so
+// the size is fixed and recording is a few relaxed atomic increments. One
+// thread records, any thread may read.
+class FireHistogram
+{
+public:
+    // Fires later than this count as missed deadlines
+    static const qint64 MissTolerance = 1000000ll;
+
+public:
+    FireHistogram();
+
+    void record(qint64 lateness);
+    // Deadlines dropped without firing, counted as missed
+    void skip(quint64 deadlines);
+    void reset();
+
+    quint64 count() const;
+    quint64 missed() const;
+    // Upper bound of the bucket holding the given fraction, in ns
+    qint64 percentile(qreal fraction) const;
+    qint64 maximum() const;
+    qint64 mean() const;
+    // Standard deviation of the lateness
+    qint64 jitter() const;
+
+    // Summary line followed by "<upper bound in us> <count>" per used bucket
+    void write(QTextStream &stream) const;
+
+private:
+    enum
+    {
+        SubBucketBits = 4,
+        SubBucketCount = 1 << SubBucketBits,
+        BucketCount = (40 - SubBucketBits) * SubBucketCount
+    };
+
+    static int bucketOf(quint64 micros);
+    static quint64 upperBoundOf(int bucket);
+
+private:
+    std::atomic<quint64> mCounts[BucketCount];
+    std::atomic<quint64> mCount;
+    std::atomic<quint64> mMissed;
+    std::atomic<qint64> mMaximum;
+    // Only the recording thread writes, so no read-modify-write is needed
+    std::atomic<double> mSum;
+    std::atomic<double> mSumSquares;
+};
+
+#endif // FIREHISTOGRAM_HPP
@@ -2,6 +2,7 @@
 #include <QPainter>
 #include <QApplication>
 #include <QDesktopWidget>
+#include <QPaintEvent>
 
 
 GlassWindow::GlassWindow()
@@ -55,11 +56,13 @@ void GlassWindow::removeAllDrawables()
 
 void GlassWindow::paintEvent(QPaintEvent *event)
 {
+    // Only the damaged region is repainted and composited
     QPainter painter(this);
     painter.setRenderHint(QPainter::Antialiasing);
+    painter.setClipRegion(event->region());
     for(const auto e : mDrawables)
     {
-        e->draw(painter);
+        e->draw(painter, event->region());
     }
 
     QMainWindow::paintEvent(event);
@@ -2,6 +2,7 @@
 #define GLASSWINDOW_HPP
 
 #include <QMainWindow>
+#include <QRegion>
 #include <set>
 class Drawable;
 
@@ -30,10 +31,11 @@ class Drawable
 public:
     Drawable() : mParent(0) { }
     virtual ~Drawable() { }
-    virtual void draw(QPainter &painter) const = 0;
+    virtual void draw(QPainter &painter, const QRegion &region) const = 0;
 
 protected:
     void requestRepaint() { if (mParent) { mParent->update(); } }
+    void requestRepaint(const QRegion &region) { if (mParent && !region.isEmpty()) { mParent->update(region); } }
     void setParent(GlassWindow *parent) const { mParent = parent; }
 
 private:
@@ -3,25 +3,31 @@
 #include "ui_MainWidget.h"
 #include "ui_MainDialog.h"
 #include "MouseRobot.hpp"
-#include "MouseRule.hpp"
 #include "GlassWindow.hpp"
 #include "uglobalhotkeys.h"
 #include <QDebug>
+#include <QDesktopWidget>
 #include <QFileDialog>
-#include <QListWidgetItem>
+#include <algorithm>
 #include <cmath>
 
-MainWindow::MainWindow(QWidget *parent, GlassWindow *glass)
+MainWindow::MainWindow(QWidget *parent, GlassWindow *glass, const QString &ruleFileName)
     : QDialog(parent)
     , mUi(new Ui::MainDialog)
     , mGlassWindow(glass)
     , mDragWinPos()
     , mDragMousePos()
     , mIsDragging(false)
-    , mTimer()
+    , mProgressTimer()
     , mHotkeyManager(new UGlobalHotkeys())
     , mMouseRobot(winId())
-    , mMouseRules(this)
+    , mScheduler(&mMouseRobot)
+    , mMouseRules()
+    , mRuleModel(mMouseRules, mScheduler)
+    , mRuleDelegate()
+    , mRuleOverlay(mMouseRules)
+    , mJournal(ruleFileName)
+    , mFileWatcher(mMouseRules, ruleFileName, &mJournal)
 {
     mUi->setupUi(this);
     setWindowFlags(Qt::SplashScreen | Qt::FramelessWindowHint);
@@ -32,19 +38,35 @@ MainWindow::MainWindow(QWidget *parent, GlassWindow *glass)
     mHotkeyManager->registerHotkey("ctrl+shift+s", MainWindow::Save);
     mHotkeyManager->registerHotkey("ctrl+shift+x", MainWindow::Exit);
     mHotkeyManager->registerHotkey("ctrl+shift+c", MainWindow::ToggleClicks);
-    mMouseRules.load("/home/thomas/mouse_rules.ini");
+    mHotkeyManager->registerHotkey("ctrl+shift+h", MainWindow::DumpHistograms);
+    QPoint origin(QApplication::desktop()->screenGeometry().center());
+    mRuleModel.setOrigin(origin);
+    mRuleOverlay.setOrigin(origin);
+    mUi->ruleList->setModel(&mRuleModel);
+    mUi->ruleList->setItemDelegate(&mRuleDelegate);
+    mGlassWindow->addDrawable(&mRuleOverlay);
+    mMouseRules.addObserver(&mRuleModel);
+    mMouseRules.addObserver(&mRuleOverlay);
+    mMouseRules.addObserver(&mScheduler);
+    mJournal.restore(mMouseRules);
+    selectMouseRule(0);
 
     connect(mHotkeyManager, &UGlobalHotkeys::activated, this, &MainWindow::triggerHotkey);
     connect(mUi->loadButton, SIGNAL(clicked(bool)), this, SLOT(loadMouseRules()));
     connect(mUi->saveButton, SIGNAL(clicked(bool)), this, SLOT(saveMouseRules()));
     connect(mUi->timerButton, SIGNAL(toggled(bool)), this, SLOT(updateTimer()));
     connect(mUi->quitButton, SIGNAL(clicked()), this, SLOT(quit()));
-    connect(&mTimer, SIGNAL(timeout()), this, SLOT(triggerMouseRules()));
+    connect(&mProgressTimer, SIGNAL(timeout()), this, SLOT(updateProgress()));
+    connect(&mRuleDelegate, SIGNAL(addClicked()), this, SLOT(addMouseRule()));
+    connect(&mRuleDelegate, SIGNAL(removeClicked()), this, SLOT(removeMouseRule()));
+    connect(mUi->ruleList->selectionModel(), SIGNAL(currentChanged(QModelIndex,QModelIndex)), this, SLOT(editMouseRule(QModelIndex,QModelIndex)));
 }
 
 
 MainWindow::~MainWindow()
 {
+    mScheduler.setActive(false);
+    mGlassWindow->removeDrawable(&mRuleOverlay);
     if (mHotkeyManager)
     {
         delete mHotkeyManager;
@@ -74,19 +96,26 @@ void MainWindow::setAlwaysOnTop(bool isAlwaysOnTop)
 }
 
 
+void MainWindow::setThreadSettings(const ThreadSettings &settings)
+{
+    mScheduler.setThreadSettings(settings);
+}
+
+
 void MainWindow::loadMouseRules()
 {
-    QString fileName = QFileDialog::getOpenFileName(this, tr("Load Mouse Rules"), ".", tr("Mouse Rule Ini (*.ini)"));
+    QString fileName = QFileDialog::getOpenFileName(this, tr("Load Mouse Rules"), ".", tr("Mouse Rules (*.ini *.acr);;Mouse Rule Ini (*.ini);;Binary Mouse Rules (*.acr)"));
     if (!fileName.isEmpty())
     {
         mMouseRules.load(fileName);
+        selectMouseRule(0);
     }
 }
 
 
 void MainWindow::saveMouseRules()
 {
-    QString fileName = QFileDialog::getSaveFileName(this, tr("Save Mouse Rules"), ".", tr("Mouse Rule Ini (*.ini)"));
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Save Mouse Rules"), ".", tr("Mouse Rule Ini (*.ini);;Binary Mouse Rules (*.acr)"));
     if (!fileName.isEmpty())
     {
         mMouseRules.save(fileName);
@@ -94,26 +123,61 @@ void MainWindow::saveMouseRules()
 }
 
 
+void MainWindow::dumpHistograms()
+{
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Dump Fire Histograms"), ".", tr("Text (*.txt)"));
+    if (!fileName.isEmpty() && !mScheduler.writeHistograms(fileName))
+    {
+        qWarning() << "Cannot write" << fileName;
+    }
+}
+
+
 void MainWindow::addMouseRule()
 {
-    mMouseRules.addRule(dynamic_cast<MouseRule*>(QObject::sender()));
+    int index = mUi->ruleList->currentIndex().row();
+    if (index > -1)
+    {
+        mMouseRules.addRule(mMouseRules.rules()[index]);
+        selectMouseRule(mMouseRules.rules().size() - 1);
+    }
 }
 
 
 void MainWindow::removeMouseRule()
 {
-    mMouseRules.removeRule(dynamic_cast<MouseRule*>(QObject::sender()));
+    int index = mUi->ruleList->currentIndex().row();
+    if (index > -1 && mMouseRules.rules().size() > 1)
+    {
+        mMouseRules.removeRule(index);
+        selectMouseRule(std::max(index - 1, 0));
+    }
 }
 
 
-void MainWindow::triggerMouseRules()
+void MainWindow::editMouseRule(const QModelIndex &current, const QModelIndex &previous)
 {
-    // Move window out of way
-    Qt::KeyboardModifiers mods = QApplication::queryKeyboardModifiers();
-    if ((mods & Qt::ShiftModifier) == 0 && (mods & Qt::ControlModifier) == 0 && !mIsDragging)
+    // Only the current row carries a real editor widget
+    if (previous.isValid())
     {
-        //move(std::max(QCursor::pos().x() - width() -10, 0), std::max(QCursor::pos().y() - height() - 10, 0));
-        mMouseRules.invoke(mMouseRobot);
+        mUi->ruleList->closePersistentEditor(previous);
+    }
+    if (current.isValid())
+    {
+        mUi->ruleList->openPersistentEditor(current);
+    }
+}
+
+
+void MainWindow::updateProgress()
+{
+    // Refresh visible rows only
+    QRect visible = mUi->ruleList->viewport()->rect();
+    QModelIndex first = mUi->ruleList->indexAt(visible.topLeft());
+    QModelIndex last = mUi->ruleList->indexAt(visible.bottomLeft());
+    if (first.isValid())
+    {
+        mRuleModel.updateProgress(first.row(), last.isValid() ? last.row() : mRuleModel.rowCount() - 1);
     }
 }
 
@@ -135,6 +199,9 @@ void MainWindow::triggerHotkey(size_t id)
     case MainWindow::ToggleClicks:
         toggleTimer();
         break;
+    case MainWindow::DumpHistograms:
+        dumpHistograms();
+        break;
     default:
         break;
     }
@@ -151,11 +218,14 @@ void MainWindow::updateTimer()
 {
     if (mUi->timerButton->isChecked())
     {
-        mTimer.start(50);
+        mScheduler.setActive(true);
+        mProgressTimer.start(100);
     }
     else
     {
-        mTimer.stop();
+        mScheduler.setActive(false);
+        mProgressTimer.stop();
+        updateProgress();
     }
 }
 
@@ -177,6 +247,7 @@ void MainWindow::mousePressEvent(QMouseEvent *event)
     mDragWinPos = pos();
     mDragMousePos = event->globalPos();
     mIsDragging = true;
+    mScheduler.setSuspended(true);
 }
 
 
@@ -196,32 +267,11 @@ void MainWindow::mouseReleaseEvent(QMouseEvent */*event*/)
     mIsDragging = false;
     mDragWinPos = QPoint();
     mDragMousePos = QPoint();
-}
-
-void MainWindow::ruleAdded(MouseRule &rule)
-{
-    QListWidgetItem *item = new QListWidgetItem();
-    item->setSizeHint(rule.sizeHint());
-    rule.setItem(item);
-    mUi->ruleList->addItem(item);
-    mUi->ruleList->setItemWidget(item, &rule);
-    mUi->ruleList->setCurrentItem(item);
-    mGlassWindow->addDrawable(&rule);
-    connect(&rule, SIGNAL(removeClicked()), this, SLOT(removeMouseRule()));
-    connect(&rule, SIGNAL(addClicked()), this, SLOT(addMouseRule()));
-    connect(&rule, SIGNAL(posPressed()), this, SLOT(startPosCapture()));
+    mScheduler.setSuspended(false);
 }
 
 
-void MainWindow::ruleRemoved(MouseRule &rule)
+void MainWindow::selectMouseRule(int index)
 {
-    Q_ASSERT(rule.item());
-    if (rule.predecessor())
-    {
-         mUi->ruleList->setCurrentItem(rule.predecessor()->item());
-    }
-    mGlassWindow->removeDrawable(&rule);
-    delete rule.item();
-    rule.setItem(0);
+    mUi->ruleList->setCurrentIndex(mRuleModel.index(index));
 }
-
@@ -6,6 +6,12 @@
 #include <QTimer>
 #include "MouseRobot.hpp"
 #include "MouseRuleConfig.hpp"
+#include "MouseRuleDelegate.hpp"
+#include "MouseRuleModel.hpp"
+#include "MouseRuleOverlay.hpp"
+#include "RuleFileWatcher.hpp"
+#include "RuleJournal.hpp"
+#include "RuleScheduler.hpp"
 
 
 namespace Ui
@@ -17,7 +23,7 @@ class MainDialog;
 class UGlobalHotkeys;
 class GlassWindow;
 
-class MainWindow : public QDialog, MouseRuleObserver
+class MainWindow : public QDialog
 {
     Q_OBJECT
 public:
@@ -26,22 +32,27 @@ public:
         Load = 1,
         Save = 2,
         Exit = 3,
-        ToggleClicks = 4
+        ToggleClicks = 4,
+        DumpHistograms = 5
     };
 
 public:
-    explicit MainWindow(QWidget *parent = 0, GlassWindow *glass = 0);
+    // Rules are restored from, autosaved to and reloaded from ruleFileName
+    explicit MainWindow(QWidget *parent = 0, GlassWindow *glass = 0, const QString &ruleFileName = RuleJournal::defaultFileName());
     ~MainWindow();
 
 public slots:
     void setAlwaysOnTop(bool isAlwaysOnTop);
+    void setThreadSettings(const ThreadSettings &settings);
     void loadMouseRules();
     void saveMouseRules();
+    void dumpHistograms();
 
 protected slots:
     void addMouseRule();
     void removeMouseRule();
-    void triggerMouseRules();
+    void editMouseRule(const QModelIndex &current, const QModelIndex &previous);
+    void updateProgress();
     void triggerHotkey(size_t id);
     void toggleTimer();
     void updateTimer();
@@ -52,8 +63,7 @@ protected:
     void mousePressEvent(QMouseEvent *event);
     void mouseMoveEvent(QMouseEvent *event);
     void mouseReleaseEvent(QMouseEvent *event);
-    void ruleAdded(MouseRule &rule);
-    void ruleRemoved(MouseRule &rule);
+    void selectMouseRule(int index);
 
 private:
     Ui::MainDialog *mUi;
@@ -61,10 +71,16 @@ private:
     QPoint mDragWinPos;
     QPoint mDragMousePos;
     bool mIsDragging;
-    QTimer mTimer;
+    QTimer mProgressTimer;
     UGlobalHotkeys *mHotkeyManager;
     MouseRobot mMouseRobot;
+    RuleScheduler mScheduler;
     MouseRuleConfig mMouseRules;
+    MouseRuleModel mRuleModel;
+    MouseRuleDelegate mRuleDelegate;
+    MouseRuleOverlay mRuleOverlay;
+    RuleJournal mJournal;
+    RuleFileWatcher mFileWatcher;
 };
 
 #endif // MAINWINDOW_H
@@ -1,25 +1,195 @@
 #include "MouseRobot.hpp"
+#include "MouseRobotBackend.hpp"
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QDebug>
+#include <QString>
+#include <QByteArray>
+#include <QPointF>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/cursorfont.h>
-#include <X11/extensions/XTest.h>
+#include <X11/XF86keysym.h>
 #include <string.h>
 #include <ctime>
-#include <cmath>
+#include <algorithm>
+#include <deque>
+#include <limits>
 #include <vector>
 
-class MouseRobot::MouseRobotImpl
+namespace
+{
+struct KeySymMapping
+{
+    int qtKey;
+    quint32 keySym;
+};
+
+// Sideways bend of Bezier motions relative to their length
+const qreal BezierBend = 0.2;
+
+
+// Qt keys that do not map onto a keysym range
+const KeySymMapping KeySymTable[] =
+{
+    { Qt::Key_Escape, XK_Escape },
+    { Qt::Key_Tab, XK_Tab },
+    { Qt::Key_Backtab, XK_ISO_Left_Tab },
+    { Qt::Key_Backspace, XK_BackSpace },
+    { Qt::Key_Return, XK_Return },
+    { Qt::Key_Enter, XK_KP_Enter },
+    { Qt::Key_Insert, XK_Insert },
+    { Qt::Key_Delete, XK_Delete },
+    { Qt::Key_Pause, XK_Pause },
+    { Qt::Key_Print, XK_Print },
+    { Qt::Key_SysReq, XK_Sys_Req },
+    { Qt::Key_Clear, XK_Clear },
+    { Qt::Key_Home, XK_Home },
+    { Qt::Key_End, XK_End },
+    { Qt::Key_Left, XK_Left },
+    { Qt::Key_Up, XK_Up },
+    { Qt::Key_Right, XK_Right },
+    { Qt::Key_Down, XK_Down },
+    { Qt::Key_PageUp, XK_Prior },
+    { Qt::Key_PageDown, XK_Next },
+    { Qt::Key_Shift, XK_Shift_L },
+    { Qt::Key_Control, XK_Control_L },
+    { Qt::Key_Meta, XK_Super_L },
+    { Qt::Key_Alt, XK_Alt_L },
+    { Qt::Key_AltGr, XK_ISO_Level3_Shift },
+    { Qt::Key_CapsLock, XK_Caps_Lock },
+    { Qt::Key_NumLock, XK_Num_Lock },
+    { Qt::Key_ScrollLock, XK_Scroll_Lock },
+    { Qt::Key_Super_L, XK_Super_L },
+    { Qt::Key_Super_R, XK_Super_R },
+    { Qt::Key_Menu, XK_Menu },
+    { Qt::Key_Hyper_L, XK_Hyper_L },
+    { Qt::Key_Hyper_R, XK_Hyper_R },
+    { Qt::Key_Help, XK_Help },
+    { Qt::Key_Undo, XK_Undo },
+    { Qt::Key_Redo, XK_Redo },
+    { Qt::Key_Find, XK_Find },
+    { Qt::Key_Cancel, XK_Cancel },
+    { Qt::Key_Execute, XK_Execute },
+    { Qt::Key_Select, XK_Select },
+    { Qt::Key_Back, XF86XK_Back },
+    { Qt::Key_Forward, XF86XK_Forward },
+    { Qt::Key_Stop, XF86XK_Stop },
+    { Qt::Key_Refresh, XF86XK_Refresh },
+    { Qt::Key_VolumeDown, XF86XK_AudioLowerVolume },
+    { Qt::Key_VolumeMute, XF86XK_AudioMute },
+    { Qt::Key_VolumeUp, XF86XK_AudioRaiseVolume },
+    { Qt::Key_MicMute, XF86XK_AudioMicMute },
+    { Qt::Key_MediaPlay, XF86XK_AudioPlay },
+    { Qt::Key_MediaStop, XF86XK_AudioStop },
+    { Qt::Key_MediaPrevious, XF86XK_AudioPrev },
+    { Qt::Key_MediaNext, XF86XK_AudioNext },
+    { Qt::Key_MediaRecord, XF86XK_AudioRecord },
+    { Qt::Key_MediaPause, XF86XK_AudioPause },
+    { Qt::Key_HomePage, XF86XK_HomePage },
+    { Qt::Key_Favorites, XF86XK_Favorites },
+    { Qt::Key_Search, XF86XK_Search },
+    { Qt::Key_Standby, XF86XK_Standby },
+    { Qt::Key_OpenUrl, XF86XK_OpenURL },
+    { Qt::Key_LaunchMail, XF86XK_Mail },
+    { Qt::Key_LaunchMedia, XF86XK_AudioMedia },
+    { Qt::Key_Launch0, XF86XK_MyComputer },
+    { Qt::Key_Calculator, XF86XK_Calculator },
+    { Qt::Key_MonBrightnessUp, XF86XK_MonBrightnessUp },
+    { Qt::Key_MonBrightnessDown, XF86XK_MonBrightnessDown },
+    { Qt::Key_KeyboardLightOnOff, XF86XK_KbdLightOnOff },
+    { Qt::Key_KeyboardBrightnessUp, XF86XK_KbdBrightnessUp },
+    { Qt::Key_KeyboardBrightnessDown, XF86XK_KbdBrightnessDown },
+    { Qt::Key_PowerOff, XF86XK_PowerOff },
+    { Qt::Key_WakeUp, XF86XK_WakeUp },
+    { Qt::Key_Eject, XF86XK_Eject },
+    { Qt::Key_ScreenSaver, XF86XK_ScreenSaver },
+    { Qt::Key_WWW, XF86XK_WWW },
+    { Qt::Key_Sleep, XF86XK_Sleep },
+    { Qt::Key_Suspend, XF86XK_Suspend },
+    { Qt::Key_Hibernate, XF86XK_Hibernate },
+    { Qt::Key_Memo, XF86XK_Memo },
+    { Qt::Key_ToDoList, XF86XK_ToDoList },
+    { Qt::Key_Calendar, XF86XK_Calendar },
+    { Qt::Key_Explorer, XF86XK_Explorer },
+    { Qt::Key_Documents, XF86XK_Documents },
+    { Qt::Key_Copy, XF86XK_Copy },
+    { Qt::Key_Cut, XF86XK_Cut },
+    { Qt::Key_Paste, XF86XK_Paste },
+    { Qt::Key_ZoomIn, XF86XK_ZoomIn },
+    { Qt::Key_ZoomOut, XF86XK_ZoomOut },
+    { Qt::Key_Reload, XF86XK_Reload },
+    { Qt::Key_Open, XF86XK_Open },
+    { Qt::Key_Close, XF86XK_Close },
+    { Qt::Key_Save, XF86XK_Save },
+    { Qt::Key_Send, XF86XK_Send },
+    { Qt::Key_Reply, XF86XK_Reply },
+    { Qt::Key_MailForward, XF86XK_MailForward },
+    { Qt::Key_Terminal, XF86XK_Terminal },
+    { Qt::Key_Tools, XF86XK_Tools },
+    { Qt::Key_Display, XF86XK_Display },
+    { Qt::Key_TouchpadToggle, XF86XK_TouchpadToggle },
+    { Qt::Key_Battery, XF86XK_Battery },
+    { Qt::Key_Bluetooth, XF86XK_Bluetooth },
+    { Qt::Key_WLAN, XF86XK_WLAN },
+    { Qt::Key_LogOff, XF86XK_LogOff }
+};
+}
+
+class MouseRobot::MouseRobotImpl : public QThread
 {
 public:
-    MouseRobotImpl(WId parentWindow)
-        : mParentWindow(parentWindow)
+    typedef MouseRobotBackend::Command Command;
+
+public:
+    MouseRobotImpl(quintptr parentWindow, MouseRobotBackend *backend)
+        : QThread()
+        , mParentWindow(parentWindow)
         , mDisplay(XOpenDisplay(NULL))
+        , mBackend(backend)
+        , mMutex()
+        , mQueueCondition()
+        , mIdleCondition()
+        , mPending()
+        , mBatches()
+        , mBursts()
+        , mBatch()
+        , mCommandIndex(0)
+        , mAhead()
+        , mMotion()
+        , mSteps()
+        , mStepIndex(0)
+        , mStepTime(0)
+        , mStepInterval(0)
+        , mQueuedCount(0)
+        , mDroppedCount(0)
+        , mIsIdle(true)
+        , mIsStopping(false)
+        , mThreadSettings()
+        , mIsThreadSettingsChanged(false)
+        , mEventCount(0)
+        , mBatchCount(0)
+        , mBatchTime(0)
+        , mMaxBatchTime(0)
+        , mReportStart(0)
     {
-
+        start();
     }
 
     ~MouseRobotImpl()
     {
+        QMutexLocker locker(&mMutex);
+        mIsStopping = true;
+        mQueueCondition.wakeOne();
+        locker.unlock();
+        wait();
+
+        if (mBackend)
+        {
+            delete mBackend;
+            mBackend = 0;
+        }
         if(mDisplay != NULL)
         {
             XCloseDisplay(mDisplay);
@@ -27,17 +197,65 @@ public:
         }
     }
 
-    XButtonEvent queryCurrentWindow() const
+    // False if the queue is full and the command was dropped
+    bool enqueue(Command::Type type, qint32 x, qint32 y, quint32 value)
+    {
+        Command command;
+        command.type = type;
+        command.x = x;
+        command.y = y;
+        command.value = value;
+
+        QMutexLocker locker(&mMutex);
+        if (mQueuedCount >= static_cast<size_t>(MaxQueuedCommands))
+        {
+            ++mDroppedCount;
+            return false;
+        }
+        mPending.push_back(command);
+        ++mQueuedCount;
+        return true;
+    }
+
+    void submit()
+    {
+        QMutexLocker locker(&mMutex);
+        if (!mPending.empty())
+        {
+            mBatches.push_back(std::vector<Command>());
+            mBatches.back().swap(mPending);
+            mQueueCondition.wakeOne();
+        }
+    }
+
+    void waitUntilIdle()
+    {
+        QMutexLocker locker(&mMutex);
+        while ((!mIsIdle || !mBatches.empty()) && !mIsStopping && isRunning())
+        {
+            mIdleCondition.wait(&mMutex);
+        }
+    }
+
+    void setThreadSettings(const ThreadSettings &settings)
+    {
+        QMutexLocker locker(&mMutex);
+        mThreadSettings = settings;
+        mIsThreadSettingsChanged = true;
+        mQueueCondition.wakeOne();
+    }
+
+    static XButtonEvent queryCurrentWindow(Display *display)
     {
         XButtonEvent event;
         memset(&event, 0x00, sizeof(event));
-        event.subwindow = DefaultRootWindow(mDisplay);
+        event.subwindow = DefaultRootWindow(display);
 
         while(event.subwindow)
         {
             event.window = event.subwindow;
             XQueryPointer(
-                mDisplay,
+                display,
                 event.window,
                 &event.root, &event.subwindow,
                 &event.x_root, &event.y_root,
@@ -47,11 +265,18 @@ public:
         return event;
     }
 
+    static qint64 now()
+    {
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return static_cast<qint64>(time.tv_sec) * 1000000000ll + time.tv_nsec;
+    }
+
     void setMouseCursor()
     {
         if(mDisplay != NULL)
         {
-            XButtonEvent event(queryCurrentWindow());
+            XButtonEvent event(queryCurrentWindow(mDisplay));
 
             // Change cursor
             Cursor cursor(XCreateFontCursor(mDisplay, XC_crosshair));
@@ -59,166 +284,437 @@ public:
         }
     }
 
-    void mouseMove(quint32 x, quint32 y)
+    void setMotion(const Motion &motion)
     {
-        if(mDisplay != NULL)
+        QMutexLocker locker(&mMutex);
+        mMotion = motion;
+    }
+
+protected:
+    void run()
+    {
+        bool isOpen = mBackend->open(mParentWindow);
+        if (!isOpen)
         {
-            XButtonEvent event;
-            memset(&event, 0x00, sizeof(event));
-            event.subwindow = DefaultRootWindow(mDisplay);
-            event.window = event.subwindow;
-            XQueryPointer(
-                mDisplay,
-                event.window,
-                &event.root, &event.subwindow,
-                &event.x_root, &event.y_root,
-                &event.x, &event.y,
-                &event.state);
+            qWarning("MouseRobot: cannot open %s backend", mBackend->name());
+        }
+        mReportStart = now();
+
+        QMutexLocker locker(&mMutex);
+        while (!mIsStopping)
+        {
+            if (mIsThreadSettingsChanged)
+            {
+                ThreadSettings settings = mThreadSettings;
+                mIsThreadSettingsChanged = false;
+                locker.unlock();
+                settings.apply("MouseRobot");
+                locker.relock();
+                continue;
+            }
 
-            int x1 = static_cast<int>(x);
-            int y1 = static_cast<int>(y);
-            int x2 = event.x_root;
-            int y2 = event.y_root;
-            int dx = x2 - x1;
-            int dy = y2 - y1;
-            int d = std::sqrt(dx * dx + dy * dy);
-            int n = std::max(1, std::min(static_cast<int>(std::sqrt(d / 10)), 10));
-            quint64 delay = 10000000ull;
-            for (int i = 0; i <= n; ++i)
+            // The next batch starts once the current one and its motions are done
+            if (mCommandIndex >= mBatch.size() && mSteps.empty() && !mBatches.empty())
+            {
+                mBatch.swap(mBatches.front());
+                mBatches.pop_front();
+                mQueuedCount -= mBatch.size();
+                mCommandIndex = 0;
+            }
+            bool isBusy = mCommandIndex < mBatch.size() || !mSteps.empty();
+            mIsIdle = !isBusy && mBursts.empty();
+            if (mIsIdle)
+            {
+                mIdleCondition.wakeAll();
+                // Input events are read while idle too, so they never pile up for long
+                if (!mQueueCondition.wait(&mMutex, EventInterval) && isOpen)
+                {
+                    locker.unlock();
+                    mBackend->processEvents();
+                    locker.relock();
+                }
+                continue;
+            }
+
+            // Only a waiting batch that moves the pointer cuts a running motion short
+            if (!mSteps.empty())
+            {
+                takeAhead();
+            }
+            bool isWaiting = !mSteps.empty() && !mBatches.empty();
+
+            // Sleep until the next motion step or burst click unless a batch comes first
+            qint64 next = mSteps.empty() ? (isBusy ? 0 : nextBurstTime()) : std::min(mStepTime, nextBurstTime());
+            qint64 wait = next - now();
+            if (wait > 0 && mAhead.empty())
+            {
+                mQueueCondition.wait(&mMutex, static_cast<unsigned long>((wait + 999999ll) / 1000000ll));
+                continue;
+            }
+            Motion motion = mMotion;
+            locker.unlock();
+
+            sendAhead(isOpen);
+            if (!mSteps.empty() && (isWaiting || now() >= mStepTime))
+            {
+                runMotion(isOpen, isWaiting);
+            }
+            if (mSteps.empty())
             {
-                quint32 curX = x2 + ((x1 - x2) * i) / n;
-                quint32 curY = y2 + ((y1 - y2) * i) / n;
-
-                // Send mouse move
-                XTestFakeMotionEvent(mDisplay, 0, curX, curY, CurrentTime);
-                XFlush(mDisplay);
-
-                // Delay (10ms)
-                timespec time;
-                time.tv_sec = 0;
-                time.tv_nsec = delay;
-                nanosleep(&time, 0);
+                runBatch(isOpen, motion);
             }
+            runBursts(isOpen);
+
+            locker.relock();
         }
+        mIsIdle = true;
+        mIdleCondition.wakeAll();
+        locker.unlock();
+
+        mBackend->close();
     }
 
-    bool mouseClick(Button button)
+private:
+    // Sends commands with one flush and accounts for them, returns the events sent
+    quint64 send(bool isOpen, const Command *commands, size_t count)
     {
-        if(mDisplay != NULL)
+        quint64 events = 0;
+        if (isOpen && count > 0)
         {
-            XButtonEvent event(queryCurrentWindow());
+            qint64 start = now();
+            events = mBackend->execute(commands, count);
+            mEventCount += events;
+            qint64 duration = now() - start;
+            mBatchTime += duration;
+            mMaxBatchTime = std::max(mMaxBatchTime, duration);
+            ++mBatchCount;
+            report();
+        }
+        return events;
+    }
 
-            // Never sent events to own window
-            if (event.window != mParentWindow)
+    // Sends the current batch up to the next paced motion
+    void runBatch(bool isOpen, const Motion &motion)
+    {
+        size_t first = mCommandIndex;
+        while (mCommandIndex < mBatch.size())
+        {
+            const Command &command = mBatch[mCommandIndex];
+            if (command.type == Command::Burst)
+            {
+                send(isOpen, &mBatch[first], mCommandIndex - first);
+                startBurst(command);
+                first = ++mCommandIndex;
+            }
+            else if (isMove(command) && motion.path != TeleportMotion && isOpen)
+            {
+                send(isOpen, &mBatch[first], mCommandIndex - first);
+                startMotion(command, motion);
+                first = ++mCommandIndex;
+                if (!mSteps.empty())
+                {
+                    return;
+                }
+            }
+            else
             {
-                // Send mouse down
-                XTestFakeButtonEvent(mDisplay, button, True, CurrentTime);
-                XFlush(mDisplay);
+                ++mCommandIndex;
+            }
+        }
+        send(isOpen, &mBatch[first], mCommandIndex - first);
+        mBatch.clear();
+        mCommandIndex = 0;
+    }
 
-                // Delay (1ms)
-                timespec time;
-                time.tv_sec = 0;
-                time.tv_nsec = 1000000;
-                nanosleep(&time, 0);
+    static bool isMove(const Command &command)
+    {
+        return command.type == Command::Move || command.type == Command::MoveBy;
+    }
 
-                // Send mouse up
-                XTestFakeButtonEvent(mDisplay, button, False, CurrentTime);
-                XFlush(mDisplay);
+    // Takes the commands of waiting batches up to their first move, they do
+    // not depend on the pointer and can go out between motion steps. Stops
+    // at a batch that moves the pointer, it has to wait for the motion.
+    void takeAhead()
+    {
+        while (!mBatches.empty())
+        {
+            std::vector<Command> &batch = mBatches.front();
+            auto move = std::find_if(batch.begin(), batch.end(), isMove);
+            mAhead.insert(mAhead.end(), batch.begin(), move);
+            mQueuedCount -= static_cast<size_t>(move - batch.begin());
+            if (move != batch.end())
+            {
+                batch.erase(batch.begin(), move);
+                return;
+            }
+            mBatches.pop_front();
+        }
+    }
 
-                return true;
+    void sendAhead(bool isOpen)
+    {
+        size_t first = 0;
+        for (size_t i = 0; i < mAhead.size(); ++i)
+        {
+            if (mAhead[i].type == Command::Burst)
+            {
+                send(isOpen, &mAhead[first], i - first);
+                startBurst(mAhead[i]);
+                first = i + 1;
             }
         }
-        return false;
+        send(isOpen, mAhead.data() + first, mAhead.size() - first);
+        mAhead.clear();
     }
 
-    void keyType(quint32 key)
+    // Precomputes the path from the pointer to the target, the first step is due right away
+    void startMotion(const Command &command, const Motion &motion)
     {
-        Window focusWindow;
-        int revert;
-        XGetInputFocus(mDisplay, &focusWindow, &revert);
+        QPointF from(mBackend->pointer());
+        QPointF to(command.x, command.y);
+        if (command.type == Command::MoveBy)
+        {
+            to += from;
+        }
 
-        // Never sent events to own window
-        if (focusWindow != mParentWindow)
+        int count = std::max(1, static_cast<int>(motion.duration * motion.rate / 1000000000ll));
+        QPointF delta(to - from);
+        QPointF normal(-delta.y() * BezierBend, delta.x() * BezierBend);
+        QPoint last(from.toPoint());
+        mSteps.clear();
+        for (int i = 1; i <= count; ++i)
         {
-            // Convert modifiers
-            quint32 keyMod = key & Qt::KeyboardModifierMask;
-            std::vector<KeyCode> modCodes;
-            if (keyMod & Qt::ShiftModifier)
+            qreal t = static_cast<qreal>(i) / count;
+            QPointF p;
+            switch (motion.path)
             {
-                modCodes.push_back(XKeysymToKeycode(mDisplay, XK_Shift_L));
-            }
-            if (keyMod & Qt::ControlModifier)
+            case TeleportMotion:
+            case LinearMotion:
+                p = from + delta * t;
+                break;
+            case EaseMotion:
+                p = from + delta * (t * t * (3.0 - 2.0 * t));
+                break;
+            case BezierMotion:
             {
-                modCodes.push_back(XKeysymToKeycode(mDisplay, XK_Control_L));
+                // Cubic curve bent to one side, eased along its length
+                qreal s = t * t * (3.0 - 2.0 * t);
+                qreal r = 1.0 - s;
+                QPointF c1(from + delta / 3.0 + normal);
+                QPointF c2(from + delta * (2.0 / 3.0) + normal);
+                p = from * (r * r * r) + c1 * (3.0 * r * r * s) + c2 * (3.0 * r * s * s) + to * (s * s * s);
+                break;
             }
-            if (keyMod & Qt::MetaModifier)
-            {
-                modCodes.push_back(XKeysymToKeycode(mDisplay, XK_Meta_L));
             }
-            if (keyMod & Qt::AltModifier)
+            // Steps that do not move the pointer are left out
+            if (p.toPoint() != last || i == count)
             {
-                modCodes.push_back(XKeysymToKeycode(mDisplay, XK_Alt_L));
+                Command step;
+                step.type = Command::Move;
+                step.x = p.toPoint().x();
+                step.y = p.toPoint().y();
+                step.value = 0;
+                mSteps.push_back(step);
+                last = p.toPoint();
             }
+        }
+        mStepIndex = 0;
+        mStepInterval = motion.duration / static_cast<qint64>(mSteps.size());
+        mStepTime = now();
+    }
 
-            // Convert key
-            key = key & ~Qt::KeyboardModifierMask;
-            if (key >= Qt::Key_F1 && key <= Qt::Key_F35)
-            {
-                key += XK_F1 - Qt::Key_F1;
-            }
-            else if (key >= Qt::Key_Left && key <= Qt::Key_Down)
+    // Sends the step due now, late steps are skipped rather than replayed.
+    // A waiting batch that moves the pointer cuts the motion short, so it
+    // never delays other rules by more than one step.
+    void runMotion(bool isOpen, bool isWaiting)
+    {
+        qint64 t = now();
+        size_t step = mStepIndex;
+        if (isWaiting)
+        {
+            step = mSteps.size() - 1;
+        }
+        else if (t > mStepTime && mStepInterval > 0)
+        {
+            step = std::min(mSteps.size() - 1, mStepIndex + static_cast<size_t>((t - mStepTime) / mStepInterval));
+        }
+        send(isOpen, &mSteps[step], 1);
+        mStepTime += static_cast<qint64>(step - mStepIndex + 1) * mStepInterval;
+        mStepIndex = step + 1;
+        if (mStepIndex >= mSteps.size())
+        {
+            mSteps.clear();
+        }
+    }
+
+    // Clicks of one button paced by a token bucket. The bucket holds at most
+    // BurstBucketTime worth of clicks, so a late wake-up never floods the
+    // server, and each refill is sent as one prebuilt batch with one flush.
+    struct Burst
+    {
+        quint32 button;
+        double rate;
+        double tokens;
+        qint64 start;
+        qint64 end;
+        qint64 refill;
+        quint64 clicks;
+        std::vector<Command> commands;
+    };
+
+    void startBurst(const Command &command)
+    {
+        qint64 t = now();
+        auto b = mBursts.begin();
+        while (b != mBursts.end() && b->button != command.value)
+        {
+            ++b;
+        }
+        if (b == mBursts.end())
+        {
+            // A running burst of the same button is extended instead
+            mBursts.push_back(Burst());
+            b = mBursts.end() - 1;
+            b->button = command.value;
+            b->tokens = 1.0;
+            b->start = t;
+            b->refill = t;
+            b->clicks = 0;
+        }
+        b->rate = command.x;
+        b->end = t + command.y * 1000000ll;
+
+        Command click;
+        click.type = Command::Click;
+        click.x = 0;
+        click.y = 0;
+        click.value = command.value;
+        size_t capacity = std::max<size_t>(1, static_cast<size_t>(b->rate * BurstBucketTime / 1000000000ll));
+        b->commands.assign(capacity, click);
+    }
+
+    qint64 nextBurstTime() const
+    {
+        qint64 next = std::numeric_limits<qint64>::max();
+        for (auto b = mBursts.begin(); b != mBursts.end(); ++b)
+        {
+            qint64 t = b->refill + static_cast<qint64>((1.0 - b->tokens) * 1000000000.0 / b->rate);
+            next = std::min(next, std::min(t, b->end));
+        }
+        return next;
+    }
+
+    void runBursts(bool isOpen)
+    {
+        qint64 t = now();
+        for (auto b = mBursts.begin(); b != mBursts.end();)
+        {
+            qint64 until = std::min(t, b->end);
+            b->tokens = std::min(b->tokens + (until - b->refill) * b->rate / 1000000000.0,
+                                 static_cast<double>(b->commands.size()));
+            b->refill = until;
+            size_t count = static_cast<size_t>(b->tokens);
+            if (count > 0)
             {
-                key -= 0xff00c1;
+                // Held modifiers or our own window swallow clicks, they still use up tokens
+                b->clicks += send(isOpen, b->commands.data(), count) / 2;
+                b->tokens -= count;
             }
-            else if (key >= Qt::Key_Space && key <= Qt::Key_QuoteLeft)
+            if (t >= b->end)
             {
-                //no conversion
+                double seconds = (b->end - b->start) / 1000000000.0;
+                qDebug("MouseRobot: burst of button %u: %llu clicks in %.3f s, %.1f/s of %.0f/s requested",
+                       b->button, static_cast<unsigned long long>(b->clicks), seconds,
+                       seconds > 0.0 ? b->clicks / seconds : 0.0, b->rate);
+                b = mBursts.erase(b);
             }
             else
             {
-                // Ignore
-                key = 0;
+                ++b;
             }
-            KeyCode keyCode = XKeysymToKeycode(mDisplay, key);
+        }
+    }
 
-            // Send mods down
-            for (auto m = modCodes.begin(); m != modCodes.end(); ++m)
+    void report()
+    {
+        // Batch time is what a scheduler tick costs on this thread, up to the flush
+        qint64 t = now();
+        qint64 elapsed = t - mReportStart;
+        if (elapsed >= ReportInterval)
+        {
+            QMutexLocker locker(&mMutex);
+            quint64 dropped = mDroppedCount;
+            mDroppedCount = 0;
+            locker.unlock();
+            if (dropped > 0)
             {
-                XTestFakeKeyEvent(mDisplay, *m, True, CurrentTime);
+                qWarning("MouseRobot: %llu commands dropped, more than %d were queued",
+                         static_cast<unsigned long long>(dropped), static_cast<int>(MaxQueuedCommands));
             }
-            XFlush(mDisplay);
-
-            // Send key down
-            XTestFakeKeyEvent(mDisplay, keyCode, True, CurrentTime);
-            XFlush(mDisplay);
-
-            // Delay (1ms)
-            timespec time;
-            time.tv_sec = 0;
-            time.tv_nsec = 1000000;
-            nanosleep(&time, 0);
-
-            // Send key up
-            XTestFakeKeyEvent(mDisplay, keyCode, False, CurrentTime);
-            XFlush(mDisplay);
-
-            // Send mods up
-            for (auto m = modCodes.rbegin(); m != modCodes.rend(); ++m)
+            if (mEventCount > 0)
             {
-                XTestFakeKeyEvent(mDisplay, *m, False, CurrentTime);
+                qDebug("MouseRobot: %s: %llu events in %llu flushes, %.1f events/s, batch %.1f us avg / %.1f us max",
+                       mBackend->name(),
+                       static_cast<unsigned long long>(mEventCount),
+                       static_cast<unsigned long long>(mBatchCount),
+                       mEventCount * 1000000000.0 / elapsed,
+                       mBatchTime / 1000.0 / mBatchCount,
+                       mMaxBatchTime / 1000.0);
             }
-            XFlush(mDisplay);
+            mEventCount = 0;
+            mBatchCount = 0;
+            mBatchTime = 0;
+            mMaxBatchTime = 0;
+            mReportStart = t;
         }
     }
 
 private:
-    WId mParentWindow;
+    // Pending input events are read at least this often while idle (ms)
+    static const unsigned long EventInterval = 100;
+    // Injection rate is logged at most this often (ns)
+    static const qint64 ReportInterval = 10000000000ll;
+    // Burst clicks that may pile up while the thread is busy (ns)
+    static const qint64 BurstBucketTime = 10000000ll;
+
+    quintptr mParentWindow;
     Display *mDisplay;
+    MouseRobotBackend *mBackend;
+    QMutex mMutex;
+    QWaitCondition mQueueCondition;
+    QWaitCondition mIdleCondition;
+    std::vector<Command> mPending;
+    std::deque<std::vector<Command> > mBatches;
+    std::vector<Burst> mBursts;
+    // Batch being sent, it may wait for a motion in the middle
+    std::vector<Command> mBatch;
+    size_t mCommandIndex;
+    // Commands of waiting batches sent during a motion, only used by the injection thread
+    std::vector<Command> mAhead;
+    Motion mMotion;
+    std::vector<Command> mSteps;
+    size_t mStepIndex;
+    qint64 mStepTime;
+    qint64 mStepInterval;
+    size_t mQueuedCount;
+    // Commands dropped since the last report
+    quint64 mDroppedCount;
+    // Nothing left to send, only changed by the injection thread
+    bool mIsIdle;
+    bool mIsStopping;
+    ThreadSettings mThreadSettings;
+    bool mIsThreadSettingsChanged;
+    quint64 mEventCount;
+    quint64 mBatchCount;
+    qint64 mBatchTime;
+    qint64 mMaxBatchTime;
+    qint64 mReportStart;
 };
 
 
-MouseRobot::MouseRobot(WId parentWindow)
-    : mImpl(new MouseRobotImpl(parentWindow))
+
+MouseRobot::MouseRobot(quintptr parentWindow, MouseRobotBackend *backend)
+    : mImpl(new MouseRobotImpl(parentWindow, backend ? backend : MouseRobotBackend::create(QString::fromLocal8Bit(qgetenv("AUTOCLICK_BACKEND")))))
 {
 
 }
@@ -234,26 +730,169 @@ MouseRobot::~MouseRobot()
 }
 
 
+MouseRobot::KeyStroke MouseRobot::compileKey(quint32 key)
+{
+    KeyStroke stroke;
+    stroke.keySym = 0;
+    stroke.modifiers = 0;
+
+    // Convert modifiers
+    quint32 keyMod = key & Qt::KeyboardModifierMask;
+    if (keyMod & Qt::ShiftModifier)
+    {
+        stroke.modifiers |= ShiftModifier;
+    }
+    if (keyMod & Qt::ControlModifier)
+    {
+        stroke.modifiers |= ControlModifier;
+    }
+    if (keyMod & Qt::AltModifier)
+    {
+        stroke.modifiers |= AltModifier;
+    }
+    if (keyMod & Qt::MetaModifier)
+    {
+        stroke.modifiers |= MetaModifier;
+    }
+
+    // Convert key
+    int qtKey = static_cast<int>(key & ~Qt::KeyboardModifierMask);
+    if ((qtKey >= Qt::Key_A && qtKey <= Qt::Key_Z)
+        || (qtKey >= Qt::Key_Agrave && qtKey <= Qt::Key_THORN && qtKey != Qt::Key_multiply))
+    {
+        // Qt names the key, keysyms distinguish case
+        stroke.keySym = qtKey + 0x20;
+    }
+    else if (qtKey >= Qt::Key_Space && qtKey <= Qt::Key_ydiaeresis)
+    {
+        // Latin-1 keysyms equal their code point
+        stroke.keySym = qtKey;
+    }
+    else if (qtKey > Qt::Key_ydiaeresis && qtKey < Qt::Key_Escape)
+    {
+        // Any other character uses a Unicode keysym
+        stroke.keySym = 0x01000000 | qtKey;
+    }
+    else if (qtKey >= Qt::Key_F1 && qtKey <= Qt::Key_F35)
+    {
+        stroke.keySym = XK_F1 + (qtKey - Qt::Key_F1);
+    }
+    else if (qtKey >= Qt::Key_Dead_Grave && qtKey <= Qt::Key_Dead_Horn)
+    {
+        stroke.keySym = XK_dead_grave + (qtKey - Qt::Key_Dead_Grave);
+    }
+    else if (qtKey >= Qt::Key_Multi_key && qtKey <= Qt::Key_Mode_switch)
+    {
+        // Input method keys share their low byte with the keysym
+        stroke.keySym = 0xff00 | (qtKey & 0xff);
+    }
+    else
+    {
+        for (size_t i = 0; i < sizeof(KeySymTable) / sizeof(KeySymTable[0]); ++i)
+        {
+            if (KeySymTable[i].qtKey == qtKey)
+            {
+                stroke.keySym = KeySymTable[i].keySym;
+                break;
+            }
+        }
+    }
+    return stroke;
+}
+
+
 void MouseRobot::setMouseCursor()
 {
     mImpl->setMouseCursor();
 }
 
 
-void MouseRobot::mouseMove(quint32 x, quint32 y)
+bool MouseRobot::mouseMove(quint32 x, quint32 y)
+{
+    return mImpl->enqueue(MouseRobotImpl::Command::Move, x, y, 0);
+}
+
+
+bool MouseRobot::mouseMoveBy(qint32 dx, qint32 dy)
 {
-    return mImpl->mouseMove(x, y);
+    return mImpl->enqueue(MouseRobotImpl::Command::MoveBy, dx, dy, 0);
 }
 
 
-void MouseRobot::mouseClick(Button button)
+bool MouseRobot::mouseClick(Button button)
 {
-    (void)mImpl->mouseClick(button);
+    return mImpl->enqueue(MouseRobotImpl::Command::Click, 0, 0, button);
 }
 
 
-void MouseRobot::keyType(quint32 key)
+bool MouseRobot::mouseBurst(Button button, quint32 rate, qint64 duration)
 {
-    mImpl->keyType(key);
+    rate = std::max(1u, std::min(rate, static_cast<quint32>(MaxBurstRate)));
+    qint64 ms = std::max<qint64>(1, std::min<qint64>(duration / 1000000ll, MaxBurstDuration));
+    return mImpl->enqueue(MouseRobotImpl::Command::Burst, static_cast<qint32>(rate), static_cast<qint32>(ms), button);
 }
 
+
+bool MouseRobot::keyType(quint32 key)
+{
+    return keyType(compileKey(key));
+}
+
+
+bool MouseRobot::keyType(const KeyStroke &stroke)
+{
+    if (stroke.keySym != 0)
+    {
+        return mImpl->enqueue(MouseRobotImpl::Command::Key, stroke.modifiers, 0, stroke.keySym);
+    }
+    return true;
+}
+
+
+void MouseRobot::submit()
+{
+    mImpl->submit();
+}
+
+
+void MouseRobot::waitUntilIdle()
+{
+    mImpl->waitUntilIdle();
+}
+
+
+void MouseRobot::setThreadSettings(const ThreadSettings &settings)
+{
+    mImpl->setThreadSettings(settings);
+}
+
+
+void MouseRobot::setMotion(const Motion &motion)
+{
+    Motion m(motion);
+    m.rate = std::max(1u, std::min(m.rate, static_cast<quint32>(MaxMotionRate)));
+    m.duration = std::max<qint64>(m.duration, 0);
+    mImpl->setMotion(m);
+}
+
+
+MouseRobot::Motion::Motion(MotionPath path, quint32 rate, qint64 duration)
+    : path(path)
+    , rate(rate)
+    , duration(duration)
+{
+}
+
+
+bool MouseRobot::Motion::operator==(const Motion &other) const
+{
+    return path == other.path
+        && rate == other.rate
+        && duration == other.duration;
+}
+
+
+bool MouseRobot::Motion::operator!=(const Motion &other) const
+{
+    return !(*this == other);
+}
@@ -1,8 +1,10 @@
 #ifndef MOUSEROBOT_H
 #define MOUSEROBOT_H
 
-#include <QtGui/qwindowdefs.h>
+#include <QtGlobal>
 #include <QPoint>
+#include "ThreadSettings.hpp"
+class MouseRobotBackend;
 
 
 class MouseRobot
@@ -19,15 +21,82 @@ public:
         Button5	= 5
     };
 
+    enum Modifier
+    {
+        ShiftModifier   = 1,
+        ControlModifier = 2,
+        AltModifier     = 4,
+        MetaModifier    = 8
+    };
+
+    // Limits of mouseBurst() in clicks per second and ms, and of motion steps per second.
+    // Commands beyond MaxQueuedCommands are dropped instead of piling up behind a stalled X server.
+    enum
+    {
+        MaxBurstRate = 10000,
+        MaxBurstDuration = 60000,
+        MaxMotionRate = 1000,
+        MaxQueuedCommands = 1024
+    };
+
+    enum MotionPath
+    {
+        TeleportMotion,
+        LinearMotion,
+        EaseMotion,
+        BezierMotion
+    };
+
+    // How mouseMove() and mouseMoveBy() travel: duration ns in rate steps per
+    // second, paced by the injection thread. Teleport jumps in one event.
+    struct Motion
+    {
+        Motion(MotionPath path = LinearMotion, quint32 rate = 1000u, qint64 duration = 50000000ll);
+
+        bool operator==(const Motion &other) const;
+        bool operator!=(const Motion &other) const;
+
+        MotionPath path;
+        quint32 rate;
+        qint64 duration;
+    };
+
+    // A key sequence converted to an X keysym plus modifier bits, keycodes
+    // are looked up by the robot from its own copy of the keymap
+    struct KeyStroke
+    {
+        quint32 keySym;
+        quint32 modifiers;
+    };
+
 public:
-    MouseRobot(WId parentWindow);
+    // Takes ownership of the backend, the default is picked by $AUTOCLICK_BACKEND
+    explicit MouseRobot(quintptr parentWindow, MouseRobotBackend *backend = 0);
     ~MouseRobot();
 
+public:
+    static KeyStroke compileKey(quint32 key);
+
 public:
     void setMouseCursor();
-    void mouseMove(quint32 x, quint32 y);
-    void mouseClick(Button button);
-    void keyType(quint32 key);
+    // Commands are queued for the next submit, they return false if the
+    // queue was full and the command was dropped
+    bool mouseMove(quint32 x, quint32 y);
+    bool mouseMoveBy(qint32 dx, qint32 dy);
+    bool mouseClick(Button button);
+    // Clicks at rate per second for duration ns where the pointer is, paced
+    // by the injection thread; a new burst of a button replaces its rate and end
+    bool mouseBurst(Button button, quint32 rate, qint64 duration);
+    bool keyType(quint32 key);
+    bool keyType(const KeyStroke &stroke);
+    // Hands everything queued since the last submit to the X server as one batch
+    void submit();
+    // Blocks until every submitted batch, motion and burst has been sent
+    void waitUntilIdle();
+    // Applied by the injection thread before its next batch
+    void setThreadSettings(const ThreadSettings &settings);
+    // Applies to moves submitted from now on
+    void setMotion(const Motion &motion);
 
  private:
     MouseRobotImpl *mImpl;
@@ -0,0 +1,314 @@
+#include "MouseRobotBackend.hpp"
+#include "MouseRobot.hpp"
+#include "XlibBackend.hpp"
+#include "XcbBackend.hpp"
+#include "RecordingBackend.hpp"
+#include "NullBackend.hpp"
+#include <QString>
+#include <X11/keysym.h>
+#include <string.h>
+#include <algorithm>
+
+
+MouseRobotBackend::MouseRobotBackend()
+    : mPointer()
+    , mScreenSize()
+    , mIsOwnWindowFocused(false)
+    , mKeyBindings()
+    , mSpareCodes()
+    , mBoundCodes()
+    , mNextBoundCode(0)
+    , mMissingKeySyms()
+    , mHeldModifierCount(0)
+{
+    memset(mModifierCodes, 0x00, sizeof(mModifierCodes));
+    memset(mIsHoldKey, 0x00, sizeof(mIsHoldKey));
+    memset(mIsKeyDown, 0x00, sizeof(mIsKeyDown));
+}
+
+
+MouseRobotBackend::~MouseRobotBackend()
+{
+}
+
+
+MouseRobotBackend *MouseRobotBackend::create(const QString &name)
+{
+    if (name.compare("xcb", Qt::CaseInsensitive) == 0)
+    {
+        return new XcbBackend();
+    }
+    if (name.compare("record", Qt::CaseInsensitive) == 0)
+    {
+        return new RecordingBackend();
+    }
+    if (name.compare("null", Qt::CaseInsensitive) == 0)
+    {
+        return new NullBackend();
+    }
+    return new XlibBackend();
+}
+
+
+quint64 MouseRobotBackend::execute(const Command *commands, size_t count)
+{
+    quint64 events = 0;
+    if (!prepare())
+    {
+        return events;
+    }
+
+    // Hold back while shift or control is pressed (e.g. for hotkeys)
+    if (mHeldModifierCount > 0)
+    {
+        return events;
+    }
+
+    // Spacing is passed to the server as event delay, nothing is flushed until the end
+    unsigned long delay = 0;
+    for (const Command *c = commands; c != commands + count; ++c)
+    {
+        switch (c->type)
+        {
+        case Command::Move:
+            moveTo(QPoint(c->x, c->y), delay, events);
+            delay = 0;
+            break;
+        case Command::MoveBy:
+            moveTo(mPointer + QPoint(c->x, c->y), delay, events);
+            delay = 0;
+            break;
+        case Command::Click:
+            // Never sent events to own window
+            if (!ownWindow().contains(mPointer))
+            {
+                // Send mouse down, then mouse up 1ms later
+                fakeButton(c->value, true, delay);
+                fakeButton(c->value, false, PressDelay);
+                events += 2;
+                delay = 0;
+            }
+            break;
+        case Command::Key:
+            // Never sent events to own window
+            if (!mIsOwnWindowFocused)
+            {
+                delay = typeKey(c->value, c->x, delay, events);
+            }
+            break;
+        case Command::Burst:
+            // Paced by the robot
+            break;
+        }
+    }
+
+    flush();
+    return events;
+}
+
+
+void MouseRobotBackend::setKeyboardMapping(const quint32 *keySyms, int minCode, int maxCode, int symsPerCode)
+{
+    mKeyBindings.clear();
+    mSpareCodes.clear();
+    for (int code = maxCode; code >= minCode; --code)
+    {
+        const quint32 *syms = keySyms + (code - minCode) * symsPerCode;
+        if (std::count(syms, syms + symsPerCode, 0u) == symsPerCode)
+        {
+            mSpareCodes.push_back(static_cast<quint8>(code));
+        }
+    }
+
+    // Unshifted level first, so keysyms on both levels are typed without shift
+    for (int level = 0; level < std::min(symsPerCode, 2); ++level)
+    {
+        for (int code = minCode; code <= maxCode; ++code)
+        {
+            quint32 sym = keySyms[(code - minCode) * symsPerCode + level];
+            if (sym != 0 && !mKeyBindings.contains(sym))
+            {
+                KeyBinding binding;
+                binding.code = static_cast<quint8>(code);
+                binding.isShifted = level == 1;
+                mKeyBindings.insert(sym, binding);
+            }
+        }
+    }
+
+    const quint32 modifierSyms[ModifierCount] = { XK_Shift_L, XK_Control_L, XK_Alt_L, XK_Super_L };
+    for (int m = 0; m < ModifierCount; ++m)
+    {
+        auto binding = mKeyBindings.constFind(modifierSyms[m]);
+        mModifierCodes[m] = binding != mKeyBindings.constEnd() ? binding->code : 0;
+    }
+
+    // Keys that hold back injection while pressed
+    const quint32 holdSyms[] = { XK_Shift_L, XK_Shift_R, XK_Control_L, XK_Control_R };
+    memset(mIsHoldKey, 0x00, sizeof(mIsHoldKey));
+    for (size_t i = 0; i < sizeof(holdSyms) / sizeof(holdSyms[0]); ++i)
+    {
+        auto binding = mKeyBindings.constFind(holdSyms[i]);
+        if (binding != mKeyBindings.constEnd())
+        {
+            mIsHoldKey[binding->code] = true;
+        }
+    }
+    mHeldModifierCount = 0;
+    for (int code = 0; code < 256; ++code)
+    {
+        if (mIsHoldKey[code] && mIsKeyDown[code])
+        {
+            ++mHeldModifierCount;
+        }
+    }
+}
+
+
+void MouseRobotBackend::setKeyDown(int keyCode, bool isDown)
+{
+    keyCode &= 0xff;
+    if (mIsKeyDown[keyCode] != isDown)
+    {
+        mIsKeyDown[keyCode] = isDown;
+        if (mIsHoldKey[keyCode])
+        {
+            mHeldModifierCount += isDown ? 1 : -1;
+        }
+    }
+}
+
+
+QPoint MouseRobotBackend::pointer()
+{
+    prepare();
+    return mPointer;
+}
+
+
+void MouseRobotBackend::processEvents()
+{
+}
+
+
+bool MouseRobotBackend::bindKey(quint8 /*keyCode*/, quint32 /*keySym*/)
+{
+    return false;
+}
+
+
+quint64 MouseRobotBackend::keyEventCount(quint32 modifiers)
+{
+    quint64 count = 2;
+    for (int m = 0; m < ModifierCount; ++m)
+    {
+        count += (modifiers & (1u << m)) != 0 ? 2 : 0;
+    }
+    return count;
+}
+
+
+quint8 MouseRobotBackend::bindMissingKey(quint32 keySym)
+{
+    // Spare keycodes first, then the one bound longest ago. The binding stays,
+    // the server's mapping notification brings it into mKeyBindings for good.
+    quint8 code = 0;
+    if (!mSpareCodes.empty())
+    {
+        code = mSpareCodes.back();
+    }
+    else if (!mBoundCodes.empty())
+    {
+        code = mBoundCodes[mNextBoundCode++ % mBoundCodes.size()];
+    }
+    if (code == 0 || !bindKey(code, keySym))
+    {
+        return 0;
+    }
+    if (!mSpareCodes.empty())
+    {
+        mSpareCodes.pop_back();
+        mBoundCodes.push_back(code);
+    }
+
+    // Known right away, the keysym the code had before is gone
+    for (auto b = mKeyBindings.begin(); b != mKeyBindings.end();)
+    {
+        if (b->code == code)
+        {
+            b = mKeyBindings.erase(b);
+        }
+        else
+        {
+            ++b;
+        }
+    }
+    KeyBinding binding;
+    binding.code = code;
+    binding.isShifted = false;
+    mKeyBindings.insert(keySym, binding);
+    qDebug("MouseRobotBackend: %s: bound keysym 0x%x to keycode %u", name(), keySym, code);
+    return code;
+}
+
+
+void MouseRobotBackend::moveTo(const QPoint &target, unsigned long delay, quint64 &events)
+{
+    // The server clamps to the screen, so does the tracked position
+    mPointer.setX(std::max(0, std::min(target.x(), mScreenSize.width() - 1)));
+    mPointer.setY(std::max(0, std::min(target.y(), mScreenSize.height() - 1)));
+    fakeMotion(mPointer, delay);
+    ++events;
+}
+
+
+unsigned long MouseRobotBackend::typeKey(quint32 keySym, quint32 modifiers, unsigned long delay, quint64 &events)
+{
+    auto binding = mKeyBindings.constFind(keySym);
+    if (binding == mKeyBindings.constEnd() && bindMissingKey(keySym) != 0)
+    {
+        binding = mKeyBindings.constFind(keySym);
+    }
+    if (binding == mKeyBindings.constEnd())
+    {
+        if (!mMissingKeySyms.contains(keySym))
+        {
+            mMissingKeySyms.insert(keySym);
+            qWarning("MouseRobotBackend: %s: keysym 0x%x is not on the keyboard and cannot be bound", name(), keySym);
+        }
+        return delay;
+    }
+    if (binding->isShifted)
+    {
+        modifiers |= MouseRobot::ShiftModifier;
+    }
+
+    quint8 modCodes[ModifierCount];
+    int modCount = 0;
+    for (int m = 0; m < ModifierCount; ++m)
+    {
+        if ((modifiers & (1u << m)) != 0 && mModifierCodes[m] != 0)
+        {
+            modCodes[modCount++] = mModifierCodes[m];
+        }
+    }
+
+    // Send mods down
+    for (int m = 0; m < modCount; ++m)
+    {
+        fakeKey(modCodes[m], true, delay);
+        delay = 0;
+    }
+
+    // Send key down, key up 1ms later
+    fakeKey(binding->code, true, delay);
+    fakeKey(binding->code, false, PressDelay);
+
+    // Send mods up
+    for (int m = modCount - 1; m >= 0; --m)
+    {
+        fakeKey(modCodes[m], false, 0);
+    }
+    events += 2 * modCount + 2;
+    return 0;
+}
@@ -0,0 +1,124 @@
+#ifndef MOUSEROBOTBACKEND_HPP
+#define MOUSEROBOTBACKEND_HPP
+
+#include <QtGlobal>
+#include <QHash>
+#include <QPoint>
+#include <QRect>
+#include <QSet>
+#include <QSize>
+#include <QString>
+#include <vector>
+
+
+// Generates the events for MouseRobot. The robot opens, drives and closes a
+// backend from its injection thread only. Batches are expanded here, the
+// backends only send single events and keep pointer, keyboard, focus and
+// own-window state up to date without blocking. Moves jump in one event,
+// smooth motions are paced step by step by the robot.
+class MouseRobotBackend
+{
+public:
+    struct Command
+    {
+        enum Type
+        {
+            Move,
+            MoveBy,
+            Click,
+            Key,
+            // Started by the robot: value is the button, x clicks/s, y duration in ms
+            Burst
+        };
+
+        Type type;
+        qint32 x;
+        qint32 y;
+        quint32 value;
+    };
+
+public:
+    MouseRobotBackend();
+    virtual ~MouseRobotBackend();
+
+    // Known names are "xlib", "xcb", "record" and "null", anything else gives the default
+    static MouseRobotBackend *create(const QString &name);
+
+public:
+    virtual const char *name() const = 0;
+    virtual bool open(quintptr parentWindow) = 0;
+    virtual void close() = 0;
+
+    // Sends one batch and flushes once, returns the number of events
+    quint64 execute(const Command *commands, size_t count);
+    quint64 execute(const std::vector<Command> &batch) { return execute(batch.data(), batch.size()); }
+    // Where the pointer is, or will be after the events sent so far
+    QPoint pointer();
+    // Reads pending events without waiting on the server, called by the
+    // robot while it is idle so they do not pile up between batches
+    virtual void processEvents();
+
+protected:
+    // Catches up with events, false if the connection is unusable
+    virtual bool prepare() = 0;
+    virtual QRect ownWindow() = 0;
+    // Delays are in ms and relative to the previous event
+    virtual void fakeMotion(const QPoint &position, unsigned long delay) = 0;
+    virtual void fakeButton(quint32 button, bool isPress, unsigned long delay) = 0;
+    virtual void fakeKey(quint8 keyCode, bool isPress, unsigned long delay) = 0;
+    virtual void flush() = 0;
+    // Resolves keycodes from the keyboard mapping, returns the delay for the next event
+    virtual unsigned long typeKey(quint32 keySym, quint32 modifiers, unsigned long delay, quint64 &events);
+    // Maps keySym to an unused keycode on the server, false if not supported
+    virtual bool bindKey(quint8 keyCode, quint32 keySym);
+    // What typing a key sends to the server: press and release of the key
+    // and of each modifier, so backends that do not send count the same
+    static quint64 keyEventCount(quint32 modifiers);
+
+protected:
+    // Fed by the backends
+    void setKeyboardMapping(const quint32 *keySyms, int minCode, int maxCode, int symsPerCode);
+    void setKeyDown(int keyCode, bool isDown);
+
+private:
+    void moveTo(const QPoint &target, unsigned long delay, quint64 &events);
+    // Binds a keysym that is not on the keyboard, as xdotool does, 0 if there is no keycode left
+    quint8 bindMissingKey(quint32 keySym);
+
+protected:
+    // Server side event delays in ms
+    enum
+    {
+        PressDelay = 1
+    };
+    // Bits of MouseRobot::Modifier
+    enum
+    {
+        ModifierCount = 4
+    };
+
+    struct KeyBinding
+    {
+        quint8 code;
+        bool isShifted;
+    };
+
+    QPoint mPointer;
+    QSize mScreenSize;
+    bool mIsOwnWindowFocused;
+
+private:
+    QHash<quint32, KeyBinding> mKeyBindings;
+    // Keycodes without keysyms, and those bound by bindMissingKey() in the order they were taken
+    std::vector<quint8> mSpareCodes;
+    std::vector<quint8> mBoundCodes;
+    size_t mNextBoundCode;
+    // Keysyms that could not be typed, each is logged once
+    QSet<quint32> mMissingKeySyms;
+    quint8 mModifierCodes[ModifierCount];
+    bool mIsHoldKey[256];
+    bool mIsKeyDown[256];
+    int mHeldModifierCount;
+};
+
+#endif // MOUSEROBOTBACKEND_HPP
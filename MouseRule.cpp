@@ -1,36 +1,25 @@
 #include "MouseRule.hpp"
-#include "MouseRobot.hpp"
 #include "ui_MouseRule.h"
 #include <QDesktopWidget>
-#include <QListWidgetItem>
 #include <QMouseEvent>
-#include <QPainter>
 
 
-MouseRule::MouseRule(QWidget *parent,
-                     QPoint position, EPositionMode positionMode,
-                     quint32 interval, EIntervalMode intervalMode,
-                     quint32 action, EActionMode actionMode)
+MouseRule::MouseRule(QWidget *parent, const MouseRuleData &rule)
     : QWidget(parent)
-    , Drawable()
     , mUi(new Ui::MouseRule)
     , mIsDragging(false)
-    , mPredecessor(0)
-    , mItem(0)
     , mPosIconAbs()
     , mPosIconRel()
-    , mTimer()
     , mPosition()
     , mPositionOffset()
     , mBasePosition(QApplication::desktop()->screenGeometry().center())
-    , mPositionMode(positionMode)
-    , mIntervalMode(intervalMode)
-    , mActionMode(actionMode)
+    , mPositionMode(rule.positionMode)
+    , mIntervalMode(rule.intervalMode)
+    , mActionMode(rule.actionMode)
+    , mCondition(rule.condition)
 {
     mUi->setupUi(this);
-    setPosition(position, positionMode);
-    setInterval(interval, intervalMode);
-    setAction(action, actionMode);
+    setData(rule);
 
     connect(mUi->removeButton, SIGNAL(clicked()), this, SIGNAL(removeClicked()));
     connect(mUi->addButton, SIGNAL(clicked()), this, SIGNAL(addClicked()));
@@ -39,11 +28,20 @@ MouseRule::MouseRule(QWidget *parent,
     connect(mUi->positionSelect, SIGNAL(activated(int)), this, SLOT(changePositionMode(int)));
     connect(mUi->intervalSelect, SIGNAL(activated(int)), this, SLOT(changeIntervalMode(int)));
     connect(mUi->actionSelect, SIGNAL(activated(int)), this, SLOT(changeActionMode(int)));
+    connect(mUi->microSecondsEdit, SIGNAL(valueChanged(int)), this, SIGNAL(changed()));
+    connect(mUi->milliSecondsEdit, SIGNAL(valueChanged(int)), this, SIGNAL(changed()));
+    connect(mUi->secondsEdit, SIGNAL(valueChanged(double)), this, SIGNAL(changed()));
+    connect(mUi->minutesEdit, SIGNAL(timeChanged(QTime)), this, SIGNAL(changed()));
+    connect(mUi->hoursEdit, SIGNAL(timeChanged(QTime)), this, SIGNAL(changed()));
+    connect(mUi->buttonSelect, SIGNAL(activated(int)), this, SIGNAL(changed()));
+    connect(mUi->keyEdit, SIGNAL(keySequenceChanged(QKeySequence)), this, SIGNAL(changed()));
+    connect(mUi->burstButtonSelect, SIGNAL(activated(int)), this, SIGNAL(changed()));
+    connect(mUi->burstRateEdit, SIGNAL(valueChanged(int)), this, SIGNAL(changed()));
+    connect(mUi->burstDurationEdit, SIGNAL(valueChanged(int)), this, SIGNAL(changed()));
     connect(mUi->absEdit, SIGNAL(textEdited(const QString&)), this, SLOT(ui2pos()));
     connect(mUi->relEdit, SIGNAL(textEdited(const QString&)), this, SLOT(ui2pos()));
     mPosIconAbs = mUi->absButton->icon();
     mPosIconRel = mUi->relButton->icon();
-    mTimer.start();
 }
 
 
@@ -57,101 +55,49 @@ MouseRule::~MouseRule()
 }
 
 
-void MouseRule::invoke(MouseRobot &robot)
+void MouseRule::setData(const MouseRuleData &rule)
 {
-    quint32 v = interval();
-    if (static_cast<quint32>(mTimer.elapsed()) >= v)
-    {
-        // Move rule
-        switch (mPositionMode)
-        {
-        case CurrentPosition:
-        {
-            break;
-        }
-        case AbsolutePosition:
-        {
-            QPointF pos = position();
-            robot.mouseMove(pos.x(), pos.y());
-            break;
-        }
-        case RelativePosition:
-        {
-            QPointF posOff = position();
-            QPoint curPos = QCursor::pos();
-            robot.mouseMove(curPos.x() + posOff.x(), curPos.y() + posOff.y());
-            break;
-        }
-        }
-
-        // Action rule
-        switch(mActionMode)
-        {
-        case ButtonAction:
-            robot.mouseClick(static_cast<MouseRobot::Button>(action()));
-            break;
-        case KeyAction:
-            robot.keyType(static_cast<quint32>(action()));
-            break;
-        case NoAction:
-            break;
-        }
-        mTimer.restart();
-    }
-    mUi->progressBar->setValue((mTimer.elapsed() * 100) / v);
+    bool wasBlocked = blockSignals(true);
+    setPosition(rule.position, rule.positionMode);
+    setInterval(rule.interval, rule.intervalMode);
+    setAction(rule.action, rule.actionMode);
+    setBurst(rule.burstRate, rule.burstDuration);
+    mCondition = rule.condition;
+    blockSignals(wasBlocked);
 }
 
 
-void MouseRule::setButtonState(bool isRemoveEnabled, bool isAddEnabled)
+MouseRuleData MouseRule::data() const
 {
-    mUi->removeButton->setEnabled(isRemoveEnabled);
-    mUi->addButton->setEnabled(isAddEnabled);
+    return MouseRuleData(position(), positionMode(),
+                         interval(), intervalMode(),
+                         action(), actionMode(),
+                         burstRate(), burstDuration(), mCondition);
 }
 
 
-int MouseRule::number() const
+void MouseRule::setProgress(qreal progress)
 {
-    return mPredecessor ? mPredecessor->number() + 1 : 0;
+    mUi->progressBar->setValue(static_cast<int>(progress * 100.0));
 }
 
 
-void MouseRule::setPredecessor(MouseRule *predRule)
-{
-    mPredecessor = predRule;
-    mUi->countLabel->setText(QString("%1").arg(number(),3, 10, QChar('0')));
-}
-
-
-MouseRule *MouseRule::predecessor()
-{
-    return mPredecessor;
-}
-
-
-QPoint MouseRule::absolutePosition() const
+void MouseRule::setButtonState(bool isRemoveEnabled, bool isAddEnabled)
 {
-    switch(mPositionMode)
-    {
-    case CurrentPosition:
-        return mPredecessor ? mPredecessor->absolutePosition() : QApplication::desktop()->screenGeometry().center();
-    case AbsolutePosition:
-        return position();
-    case RelativePosition:
-        return mPredecessor ? mPredecessor->absolutePosition() + position() : QApplication::desktop()->screenGeometry().center() + position();
-    }
-    return QPoint();
+    mUi->removeButton->setEnabled(isRemoveEnabled);
+    mUi->addButton->setEnabled(isAddEnabled);
 }
 
 
-void MouseRule::setItem(QListWidgetItem *item)
+void MouseRule::setNumber(int number)
 {
-    mItem = item;
+    mUi->countLabel->setText(QString("%1").arg(number, 3, 10, QChar('0')));
 }
 
 
-QListWidgetItem *MouseRule::item()
+void MouseRule::setBasePosition(QPoint basePosition)
 {
-    return mItem;
+    mBasePosition = basePosition;
 }
 
 
@@ -197,47 +143,53 @@ EPositionMode MouseRule::positionMode() const
 }
 
 
-void MouseRule::setInterval(quint32 interval, EIntervalMode intervalMode)
+void MouseRule::setInterval(qint64 interval, EIntervalMode intervalMode)
 {
     mIntervalMode = intervalMode;
     mUi->intervalWidget->setCurrentIndex(static_cast<int>(intervalMode));
     mUi->intervalSelect->setCurrentIndex(static_cast<int>(intervalMode));
+    int ms = static_cast<int>(interval / 1000000ll);
     switch(intervalMode)
     {
+    case MicrosecondsInterval:
+        mUi->microSecondsEdit->setValue(static_cast<int>(interval / 1000ll));
+        break;
     case MillisecondsInterval:
-        mUi->milliSecondsEdit->setValue(interval);
+        mUi->milliSecondsEdit->setValue(ms);
         break;
     case SecondsInterval:
-        mUi->secondsEdit->setValue(interval / 1000.0);
+        mUi->secondsEdit->setValue(ms / 1000.0);
         break;
     case MinutesInterval:
     case HoursInterval:
     {
         QTimeEdit *edit = mUi->intervalWidget->currentWidget()->findChild<QTimeEdit*>();
-        edit->setTime(QTime::fromMSecsSinceStartOfDay(interval));
+        edit->setTime(QTime::fromMSecsSinceStartOfDay(ms));
         break;
     }
     }
 }
 
 
-quint32 MouseRule::interval() const
+qint64 MouseRule::interval() const
 {
     switch(mIntervalMode)
     {
+    case MicrosecondsInterval:
+        return mUi->microSecondsEdit->value() * 1000ll;
     case MillisecondsInterval:
-        return mUi->milliSecondsEdit->value();
+        return mUi->milliSecondsEdit->value() * 1000000ll;
     case SecondsInterval:
-        return static_cast<quint32>(mUi->secondsEdit->value() * 1000.0 + 0.5);
+        return static_cast<qint64>(mUi->secondsEdit->value() * 1000.0 + 0.5) * 1000000ll;
     case MinutesInterval:
     case HoursInterval:
     {
         const QTimeEdit *edit = mUi->intervalWidget->currentWidget()->findChild<QTimeEdit*>();
-        return QTime(0, 0, 0, 0).msecsTo(edit->time());
+        return QTime(0, 0, 0, 0).msecsTo(edit->time()) * 1000000ll;
     }
     }
 
-    return 50;
+    return 50000000ll;
 }
 
 
@@ -263,6 +215,9 @@ void MouseRule::setAction(quint32 action, EActionMode actionMode)
         break;
     case NoAction:
         break;
+    case BurstAction:
+        mUi->burstButtonSelect->setCurrentIndex(static_cast<int>(action) - 1);
+        break;
     }
 }
 
@@ -281,6 +236,8 @@ quint32 MouseRule::action() const
         break;
     case NoAction:
         break;
+    case BurstAction:
+        return mUi->burstButtonSelect->currentIndex() + 1;
     }
     return 0;
 }
@@ -292,6 +249,25 @@ EActionMode MouseRule::actionMode() const
 }
 
 
+void MouseRule::setBurst(quint32 rate, qint64 duration)
+{
+    mUi->burstRateEdit->setValue(static_cast<int>(rate));
+    mUi->burstDurationEdit->setValue(static_cast<int>(duration / 1000000ll));
+}
+
+
+quint32 MouseRule::burstRate() const
+{
+    return mUi->burstRateEdit->value();
+}
+
+
+qint64 MouseRule::burstDuration() const
+{
+    return mUi->burstDurationEdit->value() * 1000000ll;
+}
+
+
 void MouseRule::grabMouse()
 {
     switch (mPositionMode)
@@ -309,7 +285,6 @@ void MouseRule::grabMouse()
     case RelativePosition:
     {
         mIsDragging = true;
-        mBasePosition = mPredecessor ? mPredecessor->absolutePosition() : QApplication::desktop()->screenGeometry().center();
         mUi->relButton->setIcon(QIcon());
         QPixmap p = mPosIconRel.pixmap(QSize(24, 24));
         QWidget::grabMouse(QCursor(p.scaled(24, 24, Qt::IgnoreAspectRatio, Qt::SmoothTransformation)));
@@ -330,7 +305,7 @@ void MouseRule::changePositionMode(int positionIndex)
 {
     mUi->positionWidget->setCurrentIndex(positionIndex);
     mPositionMode = static_cast<EPositionMode>(positionIndex);
-    requestRepaint();
+    emit changed();
 }
 
 
@@ -338,7 +313,7 @@ void MouseRule::changeIntervalMode(int intervalIndex)
 {
     mUi->intervalWidget->setCurrentIndex(intervalIndex);
     mIntervalMode = static_cast<EIntervalMode>(intervalIndex);
-    requestRepaint();
+    emit changed();
 }
 
 
@@ -350,7 +325,7 @@ void MouseRule::changeActionMode(int actionIndex)
     {
         mUi->keyEdit->setFocus(Qt::OtherFocusReason);
     }
-    requestRepaint();
+    emit changed();
 }
 
 
@@ -397,7 +372,7 @@ void MouseRule::ui2pos()
         break;
     }
     }
-    requestRepaint();
+    emit changed();
 }
 
 
@@ -434,7 +409,7 @@ void MouseRule::mouseMoveEvent(QMouseEvent *event)
             pos2ui();
             break;
         }
-        requestRepaint();
+        emit changed();
     }
 }
 
@@ -456,87 +431,4 @@ void MouseRule::mouseReleaseEvent(QMouseEvent */*event*/)
     }
 
     ungrabMouse();
-    requestRepaint();
-}
-
-
-void MouseRule::draw(QPainter &painter) const
-{
-    switch (mPositionMode)
-    {
-    case CurrentPosition:
-        break;
-    case AbsolutePosition:
-    {
-        QPoint pos = position();
-
-        // Draw crosshair
-        QPixmap p = mPosIconAbs.pixmap(QSize(24, 24));
-        painter.drawImage(pos.x() - 12, pos.y() - 12, p.toImage());
-
-        // Draw number
-        QFont font=painter.font() ;
-        font.setPointSize (12);
-        font.setWeight(QFont::DemiBold);
-        painter.setFont(font);
-        painter.setPen(Qt::black);  
-        int id = number();
-        for(int x = -1; x < 2; ++x)
-        {
-            for(int y = -1; y < 2; ++y)
-            {
-                painter.drawText(pos.x() + x + 12, pos.y() + y + 12, QString("%1").arg(id));
-            }
-        }
-        painter.setPen(Qt::white);
-        painter.drawText(pos.x() + 12, pos.y() + 12, QString("%1").arg(id));
-        break;
-    }
-     case RelativePosition:
-        QPoint basePos(mPredecessor ? mPredecessor->absolutePosition() : QApplication::desktop()->screenGeometry().center());
-        QPoint pos = basePos + position();
-
-        // Draw line
-        QVector<qreal> dashes;
-        dashes << 1 << 4;
-        QPen linePen(Qt::black, 4.0f, Qt::DashLine);
-        linePen.setDashPattern(dashes);
-        linePen.setDashOffset(0.0);
-        painter.setPen(linePen);
-
-        painter.drawLine(basePos, pos);
-
-        linePen.setColor(Qt::white);
-        linePen.setWidthF(2.0f);
-        dashes[0] = 2;
-        dashes[1] = 8;
-        linePen.setDashPattern(dashes);
-        linePen.setDashOffset(0.0);
-        painter.setPen(linePen);
-        painter.drawLine(basePos, pos);
-
-        // Draw crosshair
-        QPixmap p = mPosIconRel.pixmap(QSize(24, 24));
-        painter.setRenderHint(QPainter::Antialiasing);
-        painter.drawImage(pos.x() - 12, pos.y() - 12, p.toImage());
-
-        // Draw number
-        QFont font=painter.font() ;
-        font.setPointSize (12);
-        font.setWeight(QFont::DemiBold);
-        painter.setFont(font);
-        painter.setPen(Qt::black);
-        int id = number();
-        for(int x = -1; x < 2; ++x)
-        {
-            for(int y = -1; y < 2; ++y)
-            {
-                painter.drawText(pos.x() + x + 12, pos.y() + y + 12, QString("%1").arg(id));
-            }
-        }
-        painter.setPen(Qt::white);
-        painter.drawText(pos.x() + 12, pos.y() + 12, QString("%1").arg(id));
-        break;
-    }
 }
-
@@ -4,82 +4,55 @@
 #include <QWidget>
 #include <QTime>
 #include <QIcon>
-#include "GlassWindow.hpp"
+#include "MouseRuleData.hpp"
 
 
 namespace Ui
 {
 class MouseRule;
 }
-class QListWidgetItem;
-class MouseRobot;
 
 
-enum EPositionMode
-{
-    CurrentPosition,
-    AbsolutePosition,
-    RelativePosition
-};
-
-
-enum EIntervalMode
-{
-    MillisecondsInterval,
-    SecondsInterval,
-    MinutesInterval,
-    HoursInterval
-};
-
-
-enum EActionMode
-{
-    ButtonAction,
-    KeyAction,
-    NoAction
-};
-
-
-class MouseRule : public QWidget, public Drawable
+class MouseRule : public QWidget
 {
     Q_OBJECT
 
 public:
-    MouseRule(QWidget *parent = 0,
-              QPoint position = QPoint(), EPositionMode positionMode = CurrentPosition,
-              quint32 interval = 50, EIntervalMode intervalMode = MillisecondsInterval,
-              quint32 action = 1, EActionMode actionMode = ButtonAction);
+    MouseRule(QWidget *parent = 0, const MouseRuleData &rule = MouseRuleData());
     virtual ~MouseRule();
 
 signals:
     void removeClicked();
     void addClicked();
     void posPressed();
+    void changed();
 
 public:
-    void invoke(MouseRobot &robot);
+    void setData(const MouseRuleData &rule);
+    MouseRuleData data() const;
+    void setProgress(qreal progress);
     void setButtonState(bool isRemoveEnabled, bool isAddEnabled);
-    int number() const;
-
-    void setPredecessor(MouseRule *predRule);
-    MouseRule *predecessor();
-    QPoint absolutePosition() const;
-
-    void setItem(QListWidgetItem *item);
-    QListWidgetItem *item();
+    void setNumber(int number);
+    void setBasePosition(QPoint basePosition);
 
     void setPosition(QPoint position, EPositionMode positionMode);
     QPoint position() const;
     EPositionMode positionMode() const;
 
-    void setInterval(quint32 interval, EIntervalMode intervalMode);
-    quint32 interval() const;
+    // In nanoseconds
+    void setInterval(qint64 interval, EIntervalMode intervalMode);
+    qint64 interval() const;
     EIntervalMode intervalMode() const;
 
     void setAction(quint32 action, EActionMode actionMode);
     quint32 action() const;
     EActionMode actionMode() const;
 
+    // Duration in nanoseconds
+    void setBurst(quint32 rate, qint64 duration);
+    quint32 burstRate() const;
+    qint64 burstDuration() const;
+
 protected slots:
     void grabMouse();
     void ungrabMouse();
@@ -92,22 +65,20 @@ protected slots:
 protected:
     void mouseMoveEvent(QMouseEvent *event);
     void mouseReleaseEvent(QMouseEvent *event);
-    void draw(QPainter &painter) const;
 
 private:
     Ui::MouseRule *mUi;
     bool mIsDragging;
-    MouseRule *mPredecessor;
-    QListWidgetItem *mItem;
     QIcon mPosIconAbs;
     QIcon mPosIconRel;
-    QTime mTimer;
     QPoint mPosition;
     QPoint mPositionOffset;
     QPoint mBasePosition;
     EPositionMode mPositionMode;
     EIntervalMode mIntervalMode;
     EActionMode mActionMode;
+    // Only edited in the rule file, kept across edits here
+    PixelCondition mCondition;
 };
 
 #endif // MOUSERULE_HPP
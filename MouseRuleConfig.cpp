@@ -1,13 +1,304 @@
 #include "MouseRuleConfig.hpp"
+#include "BinaryRuleFile.hpp"
+#include <QFile>
+#include <QHash>
+#include <QSaveFile>
+#include <QXmlStreamReader>
 #include <QXmlStreamWriter>
+#include <algorithm>
+
+namespace
+{
+    bool isNamed(const QStringRef &name, const char *expected)
+    {
+        return name.compare(QLatin1String(expected), Qt::CaseInsensitive) == 0;
+    }
+
+
+    void warnValue(const QXmlStreamReader &reader, const QXmlStreamAttribute &attribute)
+    {
+        qWarning("MouseRuleConfig: line %lld: invalid %s \"%s\"", reader.lineNumber(),
+                 qPrintable(attribute.name().toString()), qPrintable(attribute.value().toString()));
+    }
+
+
+    // Keeps the default if the value is not a number
+    template <typename T>
+    void readNumber(const QXmlStreamReader &reader, const QXmlStreamAttribute &attribute, T &number)
+    {
+        bool isValid = false;
+        T value = T(attribute.value().toLongLong(&isValid));
+        if (isValid)
+        {
+            number = value;
+        }
+        else
+        {
+            warnValue(reader, attribute);
+        }
+    }
+
+
+    MouseRuleSettings readSettings(const QXmlStreamReader &reader)
+    {
+        MouseRuleSettings settings;
+        const QXmlStreamAttributes attributes = reader.attributes();
+        for (auto a = attributes.begin(); a != attributes.end(); ++a)
+        {
+            QStringRef key = a->name();
+            QStringRef val = a->value();
+            if (isNamed(key, "catchUp"))
+            {
+                if (isNamed(val, "skip"))
+                {
+                    settings.catchUpPolicy = SkipCatchUp;
+                }
+                else if (isNamed(val, "burst"))
+                {
+                    settings.catchUpPolicy = BurstCatchUp;
+                }
+                else if (isNamed(val, "coalesce"))
+                {
+                    settings.catchUpPolicy = CoalesceCatchUp;
+                }
+                else
+                {
+                    warnValue(reader, *a);
+                }
+            }
+            else if (isNamed(key, "motion"))
+            {
+                if (isNamed(val, "teleport"))
+                {
+                    settings.motion.path = MouseRobot::TeleportMotion;
+                }
+                else if (isNamed(val, "linear"))
+                {
+                    settings.motion.path = MouseRobot::LinearMotion;
+                }
+                else if (isNamed(val, "ease"))
+                {
+                    settings.motion.path = MouseRobot::EaseMotion;
+                }
+                else if (isNamed(val, "bezier"))
+                {
+                    settings.motion.path = MouseRobot::BezierMotion;
+                }
+                else
+                {
+                    warnValue(reader, *a);
+                }
+            }
+            else if (isNamed(key, "motionRate"))
+            {
+                readNumber(reader, *a, settings.motion.rate);
+            }
+            else if (isNamed(key, "motionDuration"))
+            {
+                quint32 duration(0u);
+                readNumber(reader, *a, duration);
+                settings.motion.duration = duration * 1000000ll;
+            }
+            else if (isNamed(key, "realtime") || isNamed(key, "lockMemory") || isNamed(key, "cpus"))
+            {
+                // Anyone can share a rule file, privileges are up to the user
+                qWarning("MouseRuleConfig: line %lld: ignoring %s, use --realtime, --lock-memory or --cpus",
+                         reader.lineNumber(), qPrintable(key.toString()));
+            }
+        }
+        return settings;
+    }
+
+
+    MouseRuleData readRule(const QXmlStreamReader &reader)
+    {
+        QPoint pos(0, 0);
+        EPositionMode posMode(CurrentPosition);
+        quint32 interval(50u);
+        EIntervalMode intervalMode(MillisecondsInterval);
+        quint32 action(1u);
+        EActionMode actionMode(ButtonAction);
+        quint32 burstRate(1000u);
+        quint32 burstDuration(1000u);
+        PixelCondition condition;
+        const QXmlStreamAttributes attributes = reader.attributes();
+        for (auto a = attributes.begin(); a != attributes.end(); ++a)
+        {
+            QStringRef key = a->name();
+            QStringRef val = a->value();
+            if (isNamed(key, "x"))
+            {
+                int x(0);
+                readNumber(reader, *a, x);
+                pos.setX(x);
+            }
+            else if (isNamed(key, "y"))
+            {
+                int y(0);
+                readNumber(reader, *a, y);
+                pos.setY(y);
+            }
+            else if (isNamed(key, "posMode"))
+            {
+                if (isNamed(val, "cur"))
+                {
+                    posMode = CurrentPosition;
+                }
+                else if (isNamed(val, "abs"))
+                {
+                    posMode = AbsolutePosition;
+                }
+                else if (isNamed(val, "rel"))
+                {
+                    posMode = RelativePosition;
+                }
+                else
+                {
+                    warnValue(reader, *a);
+                }
+            }
+            else if (isNamed(key, "interval"))
+            {
+                readNumber(reader, *a, interval);
+            }
+            else if (isNamed(key, "intervalMode"))
+            {
+                if (isNamed(val, "us"))
+                {
+                    intervalMode = MicrosecondsInterval;
+                }
+                else if (isNamed(val, "ms"))
+                {
+                    intervalMode = MillisecondsInterval;
+                }
+                else if (isNamed(val, "s"))
+                {
+                    intervalMode = SecondsInterval;
+                }
+                else if (isNamed(val, "m"))
+                {
+                    intervalMode = MinutesInterval;
+                }
+                else if (isNamed(val, "h"))
+                {
+                    intervalMode = HoursInterval;
+                }
+                else
+                {
+                    warnValue(reader, *a);
+                }
+            }
+            else if (isNamed(key, "action"))
+            {
+                readNumber(reader, *a, action);
+            }
+            else if (isNamed(key, "actionMode"))
+            {
+                if (isNamed(val, "button"))
+                {
+                    actionMode = ButtonAction;
+                }
+                else if (isNamed(val, "key"))
+                {
+                    actionMode = KeyAction;
+                }
+                else if (isNamed(val, "none"))
+                {
+                    actionMode = NoAction;
+                }
+                else if (isNamed(val, "burst"))
+                {
+                    actionMode = BurstAction;
+                }
+                else
+                {
+                    warnValue(reader, *a);
+                }
+            }
+            else if (isNamed(key, "burstRate"))
+            {
+                readNumber(reader, *a, burstRate);
+            }
+            else if (isNamed(key, "burstDuration"))
+            {
+                readNumber(reader, *a, burstDuration);
+            }
+            else if (isNamed(key, "pixelX"))
+            {
+                int x(0);
+                readNumber(reader, *a, x);
+                condition.position.setX(x);
+            }
+            else if (isNamed(key, "pixelY"))
+            {
+                int y(0);
+                readNumber(reader, *a, y);
+                condition.position.setY(y);
+            }
+            else if (isNamed(key, "pixelColor"))
+            {
+                // #rrggbb
+                bool isValid = val.startsWith(QLatin1Char('#')) && val.size() == 7;
+                quint32 color = isValid ? val.mid(1).toUInt(&isValid, 16) : 0u;
+                if (isValid)
+                {
+                    condition.color = color;
+                    condition.isEnabled = true;
+                }
+                else
+                {
+                    warnValue(reader, *a);
+                }
+            }
+            else if (isNamed(key, "pixelTolerance"))
+            {
+                readNumber(reader, *a, condition.tolerance);
+            }
+        }
+        qint64 unit = intervalMode == MicrosecondsInterval ? 1000ll : 1000000ll;
+        return MouseRuleData(pos, posMode, interval * unit, intervalMode, action, actionMode,
+                             burstRate, burstDuration * 1000000ll, condition);
+    }
+}
+
+MouseRuleSettings::MouseRuleSettings()
+    : catchUpPolicy(BurstCatchUp)
+    , motion()
+{
+}
+
+
+bool MouseRuleSettings::operator==(const MouseRuleSettings &other) const
+{
+    return catchUpPolicy == other.catchUpPolicy
+        && motion == other.motion;
+}
+
+
+bool MouseRuleSettings::operator!=(const MouseRuleSettings &other) const
+{
+    return !(*this == other);
+}
+
 
 MouseRuleConfig::MouseRuleConfig(MouseRuleObserver *observer)
-: mObserver(observer)
+: mObservers()
 , mMouseRules()
-, mMaxRules(10)
-, mIsInsideMouseRuleConfig(false)
-, mIsInsideMouseRule(false)
+, mSettings()
+, mAbsolutePositions()
+, mValidPositions(0)
+, mPositionOrigin()
 {
+    addObserver(observer);
+}
+
+
+void MouseRuleConfig::addObserver(MouseRuleObserver *observer)
+{
+    if (observer)
+    {
+        mObservers.append(observer);
+    }
 }
 
 
@@ -17,245 +308,499 @@ const MouseRules &MouseRuleConfig::rules() const
 }
 
 
-void MouseRuleConfig::addRule(const MouseRule *origRule)
+QPoint MouseRuleConfig::absolutePosition(int index, const QPoint &origin) const
+{
+    index = std::min(index, mMouseRules.size() - 1);
+    if (index < 0)
+    {
+        return origin;
+    }
+    if (origin != mPositionOrigin)
+    {
+        mPositionOrigin = origin;
+        mValidPositions = 0;
+    }
+
+    // Extend the resolved prefix up to the requested rule
+    mAbsolutePositions.resize(mMouseRules.size());
+    for (int i = mValidPositions; i <= index; ++i)
+    {
+        const MouseRuleData &rule = mMouseRules[i];
+        QPoint basePos(i > 0 ? mAbsolutePositions[i - 1] : origin);
+        switch (rule.positionMode)
+        {
+        case CurrentPosition:
+            mAbsolutePositions[i] = basePos;
+            break;
+        case AbsolutePosition:
+            mAbsolutePositions[i] = rule.position;
+            break;
+        case RelativePosition:
+            mAbsolutePositions[i] = basePos + rule.position;
+            break;
+        }
+    }
+    mValidPositions = std::max(mValidPositions, index + 1);
+    return mAbsolutePositions[index];
+}
+
+
+void MouseRuleConfig::addRule(const MouseRuleData &rule)
 {
-    MouseRule *rule = 0;
-    if (mMouseRules.size() < mMaxRules)
+    for (auto o = mObservers.begin(); o != mObservers.end(); ++o)
     {
-        rule = origRule ? new MouseRule(0,
-                                        origRule->position(), origRule->positionMode(),
-                                        origRule->interval(), origRule->intervalMode(),
-                                        origRule->action(), origRule->actionMode())
-                        : new MouseRule();
-        rule->setPredecessor(mMouseRules.empty() ? 0 : mMouseRules.back());
-        mMouseRules.append(rule);
-        update();
+        (*o)->ruleAboutToBeAdded(mMouseRules.size());
     }
-    if (mObserver && rule)
+    mMouseRules.append(rule);
+    invalidatePositions(mMouseRules.size() - 1);
+    for (auto o = mObservers.begin(); o != mObservers.end(); ++o)
     {
-        mObserver->ruleAdded(*rule);
+        (*o)->ruleAdded(mMouseRules.size() - 1, rule);
     }
 }
 
 
-void MouseRuleConfig::removeRule(MouseRule *rule)
+void MouseRuleConfig::removeRule(int index)
 {
-    if (mMouseRules.size() > 1)
+    if (mMouseRules.size() > 1 && index >= 0 && index < mMouseRules.size())
     {
-        if (rule)
+        for (auto o = mObservers.begin(); o != mObservers.end(); ++o)
         {
-            int idx = mMouseRules.indexOf(rule);
-            Q_ASSERT(idx > -1);
-            if (idx + 1 < mMouseRules.size())
-            {
-                mMouseRules[idx + 1]->setPredecessor(idx > 0 ? mMouseRules[idx - 1] : 0);
-            }
-            mMouseRules.removeAt(idx);
-            update();
-            if (mObserver)
-            {
-                mObserver->ruleRemoved(*rule);
-            }
+            (*o)->ruleAboutToBeRemoved(index);
+        }
+        mMouseRules.remove(index);
+        invalidatePositions(index);
+        for (auto o = mObservers.begin(); o != mObservers.end(); ++o)
+        {
+            (*o)->ruleRemoved(index);
         }
     }
 }
 
 
-void MouseRuleConfig::invoke(MouseRobot &robot)
+void MouseRuleConfig::setRule(int index, const MouseRuleData &rule)
 {
-    for (QList<MouseRule*>::iterator i = mMouseRules.begin(); i != mMouseRules.end(); ++i)
+    if (index >= 0 && index < mMouseRules.size() && mMouseRules[index] != rule)
     {
-        (*i)->invoke(robot);
+        mMouseRules[index] = rule;
+        invalidatePositions(index);
+        for (auto o = mObservers.begin(); o != mObservers.end(); ++o)
+        {
+            (*o)->ruleChanged(index, rule);
+        }
     }
 }
 
 
-void MouseRuleConfig::load(const QString &fileName)
+const MouseRuleSettings &MouseRuleConfig::settings() const
+{
+    return mSettings;
+}
+
+
+void MouseRuleConfig::setSettings(const MouseRuleSettings &settings)
 {
-    for (MouseRules::iterator i = mMouseRules.begin(); i != mMouseRules.end(); ++i)
+    if (mSettings != settings)
     {
-        mObserver->ruleRemoved(**i);
+        mSettings = settings;
+        for (auto o = mObservers.begin(); o != mObservers.end(); ++o)
+        {
+            (*o)->settingsChanged(mSettings);
+        }
     }
-    mMouseRules.clear();
-    mIsInsideMouseRuleConfig = false;
-    mIsInsideMouseRule = false;
+}
 
-    QFile file(fileName);
-    file.open(QIODevice::ReadOnly);
-    QXmlInputSource *source = new QXmlInputSource(&file);
-    QXmlSimpleReader xmlReader;
-    xmlReader.setDeclHandler(this);
-    xmlReader.setDTDHandler(this);
-    xmlReader.setEntityResolver(this);
-    xmlReader.setLexicalHandler(this);
-    xmlReader.setContentHandler(this);
-    xmlReader.setErrorHandler(this);
-    if (!xmlReader.parse(source))
-    {
-        qDebug("%s", errorString().toLatin1().data());
+
+bool MouseRuleConfig::load(const QString &fileName)
+{
+    notifyUpdating();
+    clear();
+    bool isLoaded = false;
+    if (BinaryRuleFile::isBinary(fileName))
+    {
+        BinaryRuleFile file(fileName);
+        isLoaded = loadBinary(file, fileName);
+    }
+    else
+    {
+        isLoaded = loadXml(fileName);
     }
     if (mMouseRules.empty())
     {
         addRule();
     }
-    file.close();
+    notifyUpdated();
+    return isLoaded;
 }
 
 
-void MouseRuleConfig::save(const QString &fileName)
+bool MouseRuleConfig::load(const QByteArray &data, const QString &fileName)
 {
-    QFile file(fileName);
-    file.open(QIODevice::WriteOnly);
-    QXmlStreamWriter stream(&file);
-    stream.setAutoFormatting(true);
-    stream.writeStartDocument();
-    stream.writeStartElement("MouseRuleConfig");
-    for (MouseRules::iterator i = mMouseRules.begin(); i != mMouseRules.end(); ++i)
+    notifyUpdating();
+    clear();
+    bool isLoaded = false;
+    if (BinaryRuleFile::isBinaryData(data))
     {
-        stream.writeStartElement("MouseRule");
-        stream.writeAttribute("x", QString::number((*i)->position().x()));
-        stream.writeAttribute("y", QString::number((*i)->position().y()));
-        switch ((*i)->positionMode())
+        BinaryRuleFile file(data);
+        isLoaded = loadBinary(file, fileName);
+    }
+    else
+    {
+        QXmlStreamReader reader(data);
+        isLoaded = readXml(reader, fileName, data.size());
+    }
+    if (mMouseRules.empty())
+    {
+        addRule();
+    }
+    notifyUpdated();
+    return isLoaded;
+}
+
+
+bool MouseRuleConfig::save(const QString &fileName)
+{
+    return write(fileName, mSettings, mMouseRules);
+}
+
+
+void MouseRuleConfig::reset(const MouseRuleSettings &settings, const MouseRules &rules)
+{
+    notifyUpdating();
+    clear();
+    setSettings(settings);
+    mMouseRules.reserve(rules.size());
+    for (MouseRules::const_iterator i = rules.begin(); i != rules.end(); ++i)
+    {
+        addRule(*i);
+    }
+    if (mMouseRules.empty())
+    {
+        addRule();
+    }
+    notifyUpdated();
+}
+
+
+void MouseRuleConfig::update(const MouseRuleSettings &settings, const MouseRules &rules)
+{
+    notifyUpdating();
+    setSettings(settings);
+
+    // Rules equal at both ends stay untouched
+    int oldSize = mMouseRules.size();
+    int newSize = rules.size();
+    int prefix = 0;
+    while (prefix < oldSize && prefix < newSize && mMouseRules[prefix] == rules[prefix])
+    {
+        ++prefix;
+    }
+    int suffix = 0;
+    while (suffix < oldSize - prefix && suffix < newSize - prefix
+           && mMouseRules[oldSize - 1 - suffix] == rules[newSize - 1 - suffix])
+    {
+        ++suffix;
+    }
+    int oldEnd = oldSize - suffix;
+    int newEnd = newSize - suffix;
+
+    // In between, equal rules in the same order are kept as anchors. Each
+    // new rule takes the first unused equal old rule after the last anchor.
+    QHash<MouseRuleData, QVector<int> > oldIndices;
+    for (int i = prefix; i < oldEnd; ++i)
+    {
+        oldIndices[mMouseRules[i]].append(i);
+    }
+    QVector<QPoint> anchors;
+    int lastOld = prefix - 1;
+    for (int n = prefix; n < newEnd && !oldIndices.isEmpty(); ++n)
+    {
+        auto candidates = oldIndices.find(rules[n]);
+        if (candidates != oldIndices.end())
         {
-            case CurrentPosition: stream.writeAttribute("posMode", "cur"); break;
-            case AbsolutePosition: stream.writeAttribute("posMode", "abs"); break;
-            case RelativePosition: stream.writeAttribute("posMode", "rel"); break;
+            const QVector<int> &indices = candidates.value();
+            auto o = std::upper_bound(indices.begin(), indices.end(), lastOld);
+            if (o != indices.end())
+            {
+                anchors.append(QPoint(*o, n));
+                lastOld = *o;
+            }
         }
-        stream.writeAttribute("interval", QString::number((*i)->interval()));
-        switch ((*i)->intervalMode())
+    }
+    anchors.append(QPoint(oldEnd, newEnd));
+
+    // Between two anchors old rules are changed into new ones, the rest is
+    // removed or inserted; index is the position in the live rules
+    int index = prefix;
+    int o = prefix;
+    int n = prefix;
+    int changed = 0;
+    int added = 0;
+    int removed = 0;
+    for (auto a = anchors.begin(); a != anchors.end(); ++a)
+    {
+        int oldCount = a->x() - o;
+        int newCount = a->y() - n;
+        for (int k = 0; k < std::min(oldCount, newCount); ++k, ++index)
         {
-            case MillisecondsInterval: stream.writeAttribute("intervalMode", "ms"); break;
-            case SecondsInterval: stream.writeAttribute("intervalMode", "s"); break;
-            case MinutesInterval: stream.writeAttribute("intervalMode", "m"); break;
-            case HoursInterval: stream.writeAttribute("intervalMode", "h"); break;
+            setRule(index, rules[n + k]);
+            ++changed;
         }
-        stream.writeAttribute("action", QString::number((*i)->action()));
-        switch ((*i)->actionMode())
+        for (int k = newCount; k < oldCount; ++k)
         {
-            case CurrentPosition: stream.writeAttribute("actionMode", "button"); break;
-            case AbsolutePosition: stream.writeAttribute("actionMode", "key"); break;
-            case RelativePosition: stream.writeAttribute("actionMode", "none"); break;
+            eraseRule(index);
+            ++removed;
         }
-        stream.writeEndElement();
+        for (int k = oldCount; k < newCount; ++k, ++index)
+        {
+            insertRule(index, rules[n + k]);
+            ++added;
+        }
+        // Skip the anchor itself
+        ++index;
+        o = a->x() + 1;
+        n = a->y() + 1;
     }
-    stream.writeEndElement();
-    stream.writeEndDocument();
-    file.close();
+    if (mMouseRules.empty())
+    {
+        addRule();
+    }
+    notifyUpdated();
+    qDebug("MouseRuleConfig: updated %d rules, %d changed, %d added, %d removed", mMouseRules.size(), changed, added, removed);
 }
 
 
-void MouseRuleConfig::update()
+bool MouseRuleConfig::write(const QString &fileName, const MouseRuleSettings &settings, const MouseRules &rules)
 {
-    for (MouseRules::iterator i = mMouseRules.begin(); i != mMouseRules.end(); ++i)
+    if (BinaryRuleFile::isBinaryName(fileName))
     {
-        if (i == mMouseRules.begin())
+        QString errorString;
+        if (!BinaryRuleFile::write(fileName, settings, rules, &errorString))
         {
-            (*i)->setButtonState(mMouseRules.size() > 1, mMouseRules.size() < mMaxRules);
+            qWarning("MouseRuleConfig: cannot write %s: %s", qPrintable(fileName), qPrintable(errorString));
+            return false;
         }
-        else
+        return true;
+    }
+    return writeXml(fileName, settings, rules);
+}
+
+
+void MouseRuleConfig::invalidatePositions(int index)
+{
+    // Rules after a changed one may be relative to it
+    mValidPositions = std::min(mValidPositions, index);
+}
+
+
+void MouseRuleConfig::insertRule(int index, const MouseRuleData &rule)
+{
+    for (auto o = mObservers.begin(); o != mObservers.end(); ++o)
+    {
+        (*o)->ruleAboutToBeAdded(index);
+    }
+    mMouseRules.insert(index, rule);
+    invalidatePositions(index);
+    for (auto o = mObservers.begin(); o != mObservers.end(); ++o)
+    {
+        (*o)->ruleAdded(index, rule);
+    }
+}
+
+
+void MouseRuleConfig::eraseRule(int index)
+{
+    for (auto o = mObservers.begin(); o != mObservers.end(); ++o)
+    {
+        (*o)->ruleAboutToBeRemoved(index);
+    }
+    mMouseRules.remove(index);
+    invalidatePositions(index);
+    for (auto o = mObservers.begin(); o != mObservers.end(); ++o)
+    {
+        (*o)->ruleRemoved(index);
+    }
+}
+
+
+void MouseRuleConfig::notifyUpdating()
+{
+    for (auto o = mObservers.begin(); o != mObservers.end(); ++o)
+    {
+        (*o)->rulesUpdating();
+    }
+}
+
+
+void MouseRuleConfig::notifyUpdated()
+{
+    for (auto o = mObservers.begin(); o != mObservers.end(); ++o)
+    {
+        (*o)->rulesUpdated();
+    }
+}
+
+
+void MouseRuleConfig::clear()
+{
+    // Observers are notified back to front, so indices of remaining rules stay valid
+    while (!mMouseRules.empty())
+    {
+        for (auto o = mObservers.begin(); o != mObservers.end(); ++o)
         {
-            (*i)->setButtonState(true, mMouseRules.size() < mMaxRules);
+            (*o)->ruleAboutToBeRemoved(mMouseRules.size() - 1);
+        }
+        mMouseRules.removeLast();
+        invalidatePositions(mMouseRules.size());
+        for (auto o = mObservers.begin(); o != mObservers.end(); ++o)
+        {
+            (*o)->ruleRemoved(mMouseRules.size());
         }
     }
+    setSettings(MouseRuleSettings());
 }
 
 
-bool MouseRuleConfig::startElement(const QString &/*namespaceURI*/, const QString &/*localName*/, const QString &qName, const QXmlAttributes &atts)
+bool MouseRuleConfig::loadXml(const QString &fileName)
 {
-    if (!mIsInsideMouseRuleConfig && qName.toUpper().compare("MOUSERULECONFIG") == 0)
+    QFile file(fileName);
+    if (file.open(QIODevice::ReadOnly))
     {
-        mIsInsideMouseRuleConfig = true;
-        return true;
+        QXmlStreamReader reader(&file);
+        return readXml(reader, fileName, file.size());
     }
-    else if (mIsInsideMouseRuleConfig && !mIsInsideMouseRule && qName.toUpper().compare("MOUSERULE") == 0)
+    qWarning("MouseRuleConfig: cannot open %s", qPrintable(fileName));
+    return false;
+}
+
+
+bool MouseRuleConfig::readXml(QXmlStreamReader &reader, const QString &fileName, qint64 size)
+{
+    if (reader.readNextStartElement() && isNamed(reader.name(), "MouseRuleConfig"))
     {
-        QPoint pos(0, 0);
-        EPositionMode posMode(CurrentPosition);
-        quint32 interval(50u);
-        EIntervalMode intervalMode(MillisecondsInterval);
-        quint32 action(1u);
-        EActionMode actionMode(ButtonAction);
-        for (int i = 0; i < atts.count(); ++i)
+        setSettings(readSettings(reader));
+        // A saved rule takes about 150 bytes
+        mMouseRules.reserve(int(size / 128));
+        while (reader.readNextStartElement())
         {
-            QString key = atts.qName(i).toUpper();
-            QString val = atts.value(i).toUpper();
-            if (key.compare("X") == 0)
-            {
-                pos.setX(val.toInt());
-            }
-            else if (key.compare("Y") == 0)
-            {
-                pos.setY(val.toInt());
-            }
-            else if (key.compare("POSMODE") == 0)
+            if (isNamed(reader.name(), "MouseRule"))
             {
-                if (val.compare("ABS") == 0)
-                {
-                    posMode = AbsolutePosition;
-                }
-                else if (val.compare("REL") == 0)
-                {
-                    posMode = RelativePosition;
-                }
-            }
-            else if (key.compare("INTERVAL") == 0)
-            {
-                interval = val.toUInt();
-            }
-            else if (key.compare("INTERVALMODE") == 0)
-            {
-                if (val.compare("S") == 0)
-                {
-                    intervalMode = SecondsInterval;
-                }
-                else if (val.compare("M") == 0)
-                {
-                    intervalMode = MinutesInterval;
-                }
-                else if (val.compare("H") == 0)
-                {
-                    intervalMode = HoursInterval;
-                }
-            }
-            else if (key.compare("ACTION") == 0)
-            {
-                action = val.toUInt();
-            }
-            else if (key.compare("ACTIONMODE") == 0)
-            {
-                if (val.compare("KEY") == 0)
-                {
-                    actionMode = KeyAction;
-                }
-                else if (val.compare("NONE") == 0)
-                {
-                    actionMode = NoAction;
-                }
+                addRule(readRule(reader));
             }
+            reader.skipCurrentElement();
         }
-        MouseRule *origRule = new MouseRule(0, pos, posMode, interval, intervalMode, action, actionMode);
-        addRule(origRule);
-        delete origRule;
-        origRule = 0;
-        mIsInsideMouseRule = true;
-        return true;
     }
-    return false;
+    else if (!reader.hasError())
+    {
+        reader.raiseError("MouseRuleConfig element expected");
+    }
+    if (reader.hasError())
+    {
+        qWarning("MouseRuleConfig: %s:%lld:%lld: %s", qPrintable(fileName), reader.lineNumber(),
+                 reader.columnNumber(), qPrintable(reader.errorString()));
+        return false;
+    }
+    return true;
 }
 
 
-bool MouseRuleConfig::endElement(const QString& /*namespaceURI*/, const QString& /*localName*/, const QString& qName)
+bool MouseRuleConfig::loadBinary(BinaryRuleFile &file, const QString &fileName)
 {
-    if (mIsInsideMouseRuleConfig && qName.toUpper().compare("MOUSERULECONFIG") == 0)
+    if (!file.open())
     {
-        mIsInsideMouseRuleConfig = false;
-        return true;
+        qWarning("MouseRuleConfig: %s: %s", qPrintable(fileName), qPrintable(file.errorString()));
+        return false;
     }
-    else if (mIsInsideMouseRuleConfig && mIsInsideMouseRule && qName.toUpper().compare("MOUSERULE") == 0)
+    setSettings(file.settings());
+    mMouseRules.reserve(file.ruleCount());
+    for (int i = 0; i < file.ruleCount(); ++i)
     {
-        mIsInsideMouseRule = false;
-        return true;
+        addRule(file.rule(i));
     }
-    return false;
+    return true;
 }
 
+
+bool MouseRuleConfig::writeXml(const QString &fileName, const MouseRuleSettings &settings, const MouseRules &rules)
+{
+    // Written to a temporary file and renamed, so a crash never leaves half a file
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning("MouseRuleConfig: cannot write %s: %s", qPrintable(fileName), qPrintable(file.errorString()));
+        return false;
+    }
+    QXmlStreamWriter stream(&file);
+    stream.setAutoFormatting(true);
+    stream.writeStartDocument();
+    stream.writeStartElement("MouseRuleConfig");
+    switch (settings.catchUpPolicy)
+    {
+        case SkipCatchUp: stream.writeAttribute("catchUp", "skip"); break;
+        case BurstCatchUp: stream.writeAttribute("catchUp", "burst"); break;
+        case CoalesceCatchUp: stream.writeAttribute("catchUp", "coalesce"); break;
+    }
+    switch (settings.motion.path)
+    {
+        case MouseRobot::TeleportMotion: stream.writeAttribute("motion", "teleport"); break;
+        case MouseRobot::LinearMotion: stream.writeAttribute("motion", "linear"); break;
+        case MouseRobot::EaseMotion: stream.writeAttribute("motion", "ease"); break;
+        case MouseRobot::BezierMotion: stream.writeAttribute("motion", "bezier"); break;
+    }
+    stream.writeAttribute("motionRate", QString::number(settings.motion.rate));
+    stream.writeAttribute("motionDuration", QString::number(settings.motion.duration / 1000000ll));
+    const MouseRuleData defaults;
+    for (MouseRules::const_iterator i = rules.begin(); i != rules.end(); ++i)
+    {
+        stream.writeStartElement("MouseRule");
+        stream.writeAttribute("x", QString::number(i->position.x()));
+        stream.writeAttribute("y", QString::number(i->position.y()));
+        switch (i->positionMode)
+        {
+            case CurrentPosition: stream.writeAttribute("posMode", "cur"); break;
+            case AbsolutePosition: stream.writeAttribute("posMode", "abs"); break;
+            case RelativePosition: stream.writeAttribute("posMode", "rel"); break;
+        }
+        // Microsecond intervals are saved in us, all others in ms
+        bool isMicroseconds = i->intervalMode == MicrosecondsInterval;
+        stream.writeAttribute("interval", QString::number(i->interval / (isMicroseconds ? 1000ll : 1000000ll)));
+        switch (i->intervalMode)
+        {
+            case MicrosecondsInterval: stream.writeAttribute("intervalMode", "us"); break;
+            case MillisecondsInterval: stream.writeAttribute("intervalMode", "ms"); break;
+            case SecondsInterval: stream.writeAttribute("intervalMode", "s"); break;
+            case MinutesInterval: stream.writeAttribute("intervalMode", "m"); break;
+            case HoursInterval: stream.writeAttribute("intervalMode", "h"); break;
+        }
+        stream.writeAttribute("action", QString::number(i->action));
+        switch (i->actionMode)
+        {
+            case ButtonAction: stream.writeAttribute("actionMode", "button"); break;
+            case KeyAction: stream.writeAttribute("actionMode", "key"); break;
+            case NoAction: stream.writeAttribute("actionMode", "none"); break;
+            case BurstAction: stream.writeAttribute("actionMode", "burst"); break;
+        }
+        // Kept for other actions too, so converting from a binary file loses nothing
+        if (i->actionMode == BurstAction || i->burstRate != defaults.burstRate || i->burstDuration != defaults.burstDuration)
+        {
+            stream.writeAttribute("burstRate", QString::number(i->burstRate));
+            stream.writeAttribute("burstDuration", QString::number(i->burstDuration / 1000000ll));
+        }
+        if (i->condition.isEnabled)
+        {
+            stream.writeAttribute("pixelX", QString::number(i->condition.position.x()));
+            stream.writeAttribute("pixelY", QString::number(i->condition.position.y()));
+            stream.writeAttribute("pixelColor", QString("#%1").arg(i->condition.color, 6, 16, QChar('0')));
+            stream.writeAttribute("pixelTolerance", QString::number(i->condition.tolerance));
+        }
+        stream.writeEndElement();
+    }
+    stream.writeEndElement();
+    stream.writeEndDocument();
+    if (stream.hasError() || !file.commit())
+    {
+        qWarning("MouseRuleConfig: cannot write %s: %s", qPrintable(fileName), qPrintable(file.errorString()));
+        return false;
+    }
+    return true;
+}
@@ -3,47 +3,105 @@
 
 
 #include <QObject>
-#include <QXmlDefaultHandler>
-#include "MouseRule.hpp"
-class MouseRobot;
-typedef QList<MouseRule*> MouseRules;
+#include <QVector>
+#include <QPoint>
+#include "MouseRuleData.hpp"
+typedef QVector<MouseRuleData> MouseRules;
+class BinaryRuleFile;
+class QXmlStreamReader;
+
+
+// What the scheduler does with deadlines that passed while it was behind
+enum ECatchUpPolicy
+{
+    SkipCatchUp,
+    BurstCatchUp,
+    CoalesceCatchUp
+};
+
+
+// Settings of a rule file that apply to all of its rules
+struct MouseRuleSettings
+{
+    MouseRuleSettings();
+
+    bool operator==(const MouseRuleSettings &other) const;
+    bool operator!=(const MouseRuleSettings &other) const;
+
+    ECatchUpPolicy catchUpPolicy;
+    MouseRobot::Motion motion;
+};
 
 
 class MouseRuleObserver
 {
 public:
     virtual ~MouseRuleObserver() { }
-    virtual void ruleAdded(MouseRule &rule) = 0;
-    virtual void ruleRemoved(MouseRule &rule) = 0;
+    // Sent before the rules change, e.g. for QAbstractItemModel::beginInsertRows()
+    virtual void ruleAboutToBeAdded(int /*index*/) { }
+    virtual void ruleAboutToBeRemoved(int /*index*/) { }
+    virtual void ruleAdded(int index, const MouseRuleData &rule) = 0;
+    virtual void ruleChanged(int index, const MouseRuleData &rule) = 0;
+    virtual void ruleRemoved(int index) = 0;
+    virtual void settingsChanged(const MouseRuleSettings &/*settings*/) { }
+    // Bracket changes that must take effect at once, like a reload
+    virtual void rulesUpdating() { }
+    virtual void rulesUpdated() { }
 };
 
 
-class MouseRuleConfig : public QObject, QXmlDefaultHandler
+class MouseRuleConfig : public QObject
 {
     Q_OBJECT
 
 public:
-    MouseRuleConfig(MouseRuleObserver *observer);
+    MouseRuleConfig(MouseRuleObserver *observer = 0);
+    void addObserver(MouseRuleObserver *observer);
     const MouseRules &rules() const;
-    void addRule(const MouseRule *origRule = 0);
-    void removeRule(MouseRule *rule);
+    QPoint absolutePosition(int index, const QPoint &origin) const;
+    void addRule(const MouseRuleData &rule = MouseRuleData());
+    void removeRule(int index);
+    void setRule(int index, const MouseRuleData &rule);
+    const MouseRuleSettings &settings() const;
+    void setSettings(const MouseRuleSettings &settings);
 
 public slots:
-    void invoke(MouseRobot &robot);
-    void load(const QString &fileName);
-    void save(const QString &fileName);
+    // Binary rule files are recognized by their content when loading and
+    // written when the name ends in .acr, everything else is XML
+    bool load(const QString &fileName);
+    bool save(const QString &fileName);
+
+public:
+    // Loads the content of fileName already read into data, so it can be
+    // checksummed first; fileName only names it in messages
+    bool load(const QByteArray &data, const QString &fileName);
+
+public:
+    // Replaces all rules and settings, as loading a file does
+    void reset(const MouseRuleSettings &settings, const MouseRules &rules);
+    // Changes only what differs, so unchanged rules keep their timers
+    void update(const MouseRuleSettings &settings, const MouseRules &rules);
+    static bool write(const QString &fileName, const MouseRuleSettings &settings, const MouseRules &rules);
 
 protected:
-    void update();
-    bool startElement(const QString &namespaceURI, const QString &localName, const QString &qName, const QXmlAttributes &atts);
-    bool endElement(const QString& namespaceURI, const QString& localName, const QString& qName);
+    void invalidatePositions(int index);
+    void insertRule(int index, const MouseRuleData &rule);
+    void eraseRule(int index);
+    void notifyUpdating();
+    void notifyUpdated();
+    void clear();
+    bool loadXml(const QString &fileName);
+    bool readXml(QXmlStreamReader &reader, const QString &fileName, qint64 size);
+    bool loadBinary(BinaryRuleFile &file, const QString &fileName);
+    static bool writeXml(const QString &fileName, const MouseRuleSettings &settings, const MouseRules &rules);
 
 private:
-    MouseRuleObserver *mObserver;
+    QList<MouseRuleObserver*> mObservers;
     MouseRules mMouseRules;
-    const qint32 mMaxRules;
-    bool mIsInsideMouseRuleConfig;
-    bool mIsInsideMouseRule;
+    MouseRuleSettings mSettings;
+    mutable QVector<QPoint> mAbsolutePositions;
+    mutable int mValidPositions;
+    mutable QPoint mPositionOrigin;
 };
 
 #endif // MOUSERULECONFIG_H
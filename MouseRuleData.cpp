@@ -0,0 +1,131 @@
+#include "MouseRuleData.hpp"
+#include "MouseRobot.hpp"
+#include <QHash>
+
+
+PixelCondition::PixelCondition(bool isEnabled, QPoint position, quint32 color, quint32 tolerance)
+    : isEnabled(isEnabled)
+    , position(position)
+    , color(color)
+    , tolerance(tolerance)
+{
+}
+
+
+bool PixelCondition::operator==(const PixelCondition &other) const
+{
+    return isEnabled == other.isEnabled
+        && position == other.position
+        && color == other.color
+        && tolerance == other.tolerance;
+}
+
+
+bool PixelCondition::operator!=(const PixelCondition &other) const
+{
+    return !(*this == other);
+}
+
+
+MouseRuleData::MouseRuleData(QPoint position, EPositionMode positionMode,
+                             qint64 interval, EIntervalMode intervalMode,
+                             quint32 action, EActionMode actionMode,
+                             quint32 burstRate, qint64 burstDuration,
+                             const PixelCondition &condition)
+    : position(position)
+    , positionMode(positionMode)
+    , interval(interval)
+    , intervalMode(intervalMode)
+    , action(action)
+    , actionMode(actionMode)
+    , burstRate(burstRate)
+    , burstDuration(burstDuration)
+    , condition(condition)
+{
+}
+
+
+bool MouseRuleData::operator==(const MouseRuleData &other) const
+{
+    return position == other.position
+        && positionMode == other.positionMode
+        && interval == other.interval
+        && intervalMode == other.intervalMode
+        && action == other.action
+        && actionMode == other.actionMode
+        && burstRate == other.burstRate
+        && burstDuration == other.burstDuration
+        && condition == other.condition;
+}
+
+
+bool MouseRuleData::operator!=(const MouseRuleData &other) const
+{
+    return !(*this == other);
+}
+
+
+uint qHash(const MouseRuleData &rule, uint seed)
+{
+    uint hash = qHash(rule.interval, seed);
+    hash = hash * 31 + qHash((qint64(rule.position.x()) << 32) | quint32(rule.position.y()), seed);
+    hash = hash * 31 + (uint(rule.positionMode) | uint(rule.intervalMode) << 4 | uint(rule.actionMode) << 8);
+    hash = hash * 31 + rule.action;
+    hash = hash * 31 + qHash(rule.burstDuration, seed) + rule.burstRate;
+    hash = hash * 31 + (rule.condition.isEnabled ? rule.condition.color : 0u);
+    return hash;
+}
+
+
+bool MouseRuleData::invoke(MouseRobot &robot) const
+{
+    return MouseRuleAction(*this).invoke(robot);
+}
+
+
+MouseRuleAction::MouseRuleAction(const MouseRuleData &rule)
+    : position(rule.position)
+    , positionMode(rule.positionMode)
+    , actionMode(rule.actionMode)
+    , button(static_cast<MouseRobot::Button>(rule.action))
+    , key(MouseRobot::compileKey(rule.actionMode == KeyAction ? rule.action : 0))
+    , burstRate(rule.burstRate)
+    , burstDuration(rule.burstDuration)
+{
+}
+
+
+bool MouseRuleAction::invoke(MouseRobot &robot) const
+{
+    bool isQueued = true;
+
+    // Move rule
+    switch (positionMode)
+    {
+    case CurrentPosition:
+        break;
+    case AbsolutePosition:
+        isQueued = robot.mouseMove(position.x(), position.y());
+        break;
+    case RelativePosition:
+        isQueued = robot.mouseMoveBy(position.x(), position.y());
+        break;
+    }
+
+    // Action rule
+    switch(actionMode)
+    {
+    case ButtonAction:
+        isQueued = robot.mouseClick(button) && isQueued;
+        break;
+    case KeyAction:
+        isQueued = robot.keyType(key) && isQueued;
+        break;
+    case NoAction:
+        break;
+    case BurstAction:
+        isQueued = robot.mouseBurst(button, burstRate, burstDuration) && isQueued;
+        break;
+    }
+    return isQueued;
+}
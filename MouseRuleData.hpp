@@ -0,0 +1,102 @@
+#ifndef MOUSERULEDATA_HPP
+#define MOUSERULEDATA_HPP
+
+#include <QPoint>
+#include "MouseRobot.hpp"
+
+
+enum EPositionMode
+{
+    CurrentPosition,
+    AbsolutePosition,
+    RelativePosition
+};
+
+
+enum EIntervalMode
+{
+    MillisecondsInterval,
+    SecondsInterval,
+    MinutesInterval,
+    HoursInterval,
+    MicrosecondsInterval
+};
+
+
+enum EActionMode
+{
+    ButtonAction,
+    KeyAction,
+    NoAction,
+    BurstAction
+};
+
+
+// Fire only while the screen pixel at position (absolute) has color
+// (0xRRGGBB), each channel within tolerance
+struct PixelCondition
+{
+    PixelCondition(bool isEnabled = false, QPoint position = QPoint(), quint32 color = 0u, quint32 tolerance = 0u);
+
+    bool operator==(const PixelCondition &other) const;
+    bool operator!=(const PixelCondition &other) const;
+
+    bool isEnabled;
+    QPoint position;
+    quint32 color;
+    quint32 tolerance;
+};
+
+
+// Plain value type describing one rule, independent of any widget.
+// The interval is stored in nanoseconds; intervalMode is only the unit
+// it is edited and saved in.
+struct MouseRuleData
+{
+    MouseRuleData(QPoint position = QPoint(), EPositionMode positionMode = CurrentPosition,
+                  qint64 interval = 50000000ll, EIntervalMode intervalMode = MillisecondsInterval,
+                  quint32 action = 1, EActionMode actionMode = ButtonAction,
+                  quint32 burstRate = 1000u, qint64 burstDuration = 1000000000ll,
+                  const PixelCondition &condition = PixelCondition());
+
+    bool operator==(const MouseRuleData &other) const;
+    bool operator!=(const MouseRuleData &other) const;
+
+    // False if the robot's queue was full and a command was dropped
+    bool invoke(MouseRobot &robot) const;
+
+    QPoint position;
+    EPositionMode positionMode;
+    qint64 interval;
+    EIntervalMode intervalMode;
+    quint32 action;
+    EActionMode actionMode;
+    // Clicks per second and length of a burst, action is the button
+    quint32 burstRate;
+    qint64 burstDuration;
+    PixelCondition condition;
+};
+
+
+uint qHash(const MouseRuleData &rule, uint seed = 0);
+
+
+// A rule prepared for firing. The key sequence is converted once when the
+// rule is edited, so invoking does no conversion and no allocation.
+struct MouseRuleAction
+{
+    explicit MouseRuleAction(const MouseRuleData &rule = MouseRuleData());
+
+    // False if the robot's queue was full and a command was dropped
+    bool invoke(MouseRobot &robot) const;
+
+    QPoint position;
+    EPositionMode positionMode;
+    EActionMode actionMode;
+    MouseRobot::Button button;
+    MouseRobot::KeyStroke key;
+    quint32 burstRate;
+    qint64 burstDuration;
+};
+
+#endif // MOUSERULEDATA_HPP
@@ -0,0 +1,176 @@
+#include "MouseRuleDelegate.hpp"
+#include "MouseRuleModel.hpp"
+#include "MouseRule.hpp"
+#include <QKeySequence>
+#include <QPainter>
+#include <QTime>
+
+
+MouseRuleDelegate::MouseRuleDelegate(QObject *parent)
+    : QStyledItemDelegate(parent)
+    , mRowSize(MouseRule().sizeHint())
+{
+}
+
+
+void MouseRuleDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    MouseRuleData rule = index.data(MouseRuleModel::RuleRole).value<MouseRuleData>();
+    qreal progress = index.data(MouseRuleModel::ProgressRole).toReal();
+
+    painter->save();
+    painter->setRenderHint(QPainter::Antialiasing);
+
+    // Frame, same look as the editor
+    QRectF frame = QRectF(option.rect).adjusted(0.5, 0.5, -0.5, -0.5);
+    QLinearGradient gradient(frame.topLeft(), frame.bottomLeft());
+    gradient.setColorAt(0.0, QColor(240, 240, 240));
+    gradient.setColorAt(0.2, QColor(220, 220, 220));
+    gradient.setColorAt(0.8, QColor(200, 200, 200));
+    gradient.setColorAt(1.0, QColor(180, 180, 180));
+    painter->setPen(QColor(150, 150, 150));
+    painter->setBrush(gradient);
+    painter->drawRoundedRect(frame, 5, 5);
+
+    // Columns: number, interval, position, action
+    QRect textRect = option.rect.adjusted(6, 2, -6, -8);
+    int numberWidth = option.fontMetrics.width("0000");
+    int columnWidth = (textRect.width() - numberWidth) / 3;
+    QRect column(textRect.left(), textRect.top(), numberWidth, textRect.height());
+    painter->setPen(option.palette.color(QPalette::Text));
+    painter->drawText(column, Qt::AlignLeft | Qt::AlignVCenter, QString("%1").arg(index.row(), 3, 10, QChar('0')));
+    column.translate(numberWidth, 0);
+    column.setWidth(columnWidth);
+    painter->drawText(column, Qt::AlignLeft | Qt::AlignVCenter, intervalText(rule));
+    column.translate(columnWidth, 0);
+    painter->drawText(column, Qt::AlignLeft | Qt::AlignVCenter, positionText(rule));
+    column.translate(columnWidth, 0);
+    QString action = actionText(rule);
+    if (rule.condition.isEnabled)
+    {
+        action += tr(" if %1").arg(conditionText(rule.condition));
+    }
+    painter->drawText(column, Qt::AlignLeft | Qt::AlignVCenter, action);
+
+    // Progress
+    QRect bar(option.rect.left() + 6, option.rect.bottom() - 7, option.rect.width() - 12, 5);
+    painter->setPen(Qt::NoPen);
+    painter->setBrush(QColor(150, 150, 150));
+    painter->drawRect(bar);
+    bar.setWidth(static_cast<int>(bar.width() * progress));
+    painter->setBrush(option.palette.color(QPalette::Highlight));
+    painter->drawRect(bar);
+
+    painter->restore();
+}
+
+
+QSize MouseRuleDelegate::sizeHint(const QStyleOptionViewItem &/*option*/, const QModelIndex &/*index*/) const
+{
+    return mRowSize;
+}
+
+
+QWidget *MouseRuleDelegate::createEditor(QWidget *parent, const QStyleOptionViewItem &/*option*/, const QModelIndex &/*index*/) const
+{
+    MouseRule *editor = new MouseRule(parent);
+    connect(editor, SIGNAL(changed()), this, SLOT(commitRule()));
+    connect(editor, SIGNAL(removeClicked()), this, SIGNAL(removeClicked()));
+    connect(editor, SIGNAL(addClicked()), this, SIGNAL(addClicked()));
+    return editor;
+}
+
+
+void MouseRuleDelegate::setEditorData(QWidget *editor, const QModelIndex &index) const
+{
+    MouseRule *ruleEditor = static_cast<MouseRule*>(editor);
+    MouseRuleData rule = index.data(MouseRuleModel::RuleRole).value<MouseRuleData>();
+
+    // Do not echo the editor's own changes back while the user is typing
+    if (ruleEditor->data() != rule)
+    {
+        ruleEditor->setData(rule);
+    }
+    ruleEditor->setNumber(index.row());
+    ruleEditor->setBasePosition(index.data(MouseRuleModel::BasePositionRole).toPoint());
+    ruleEditor->setButtonState(index.model()->rowCount() > 1, true);
+    ruleEditor->setProgress(index.data(MouseRuleModel::ProgressRole).toReal());
+}
+
+
+void MouseRuleDelegate::setModelData(QWidget *editor, QAbstractItemModel *model, const QModelIndex &index) const
+{
+    MouseRule *ruleEditor = static_cast<MouseRule*>(editor);
+    model->setData(index, QVariant::fromValue(ruleEditor->data()), MouseRuleModel::RuleRole);
+}
+
+
+void MouseRuleDelegate::updateEditorGeometry(QWidget *editor, const QStyleOptionViewItem &option, const QModelIndex &/*index*/) const
+{
+    editor->setGeometry(option.rect);
+}
+
+
+void MouseRuleDelegate::commitRule()
+{
+    emit commitData(static_cast<QWidget*>(QObject::sender()));
+}
+
+
+QString MouseRuleDelegate::positionText(const MouseRuleData &rule)
+{
+    switch (rule.positionMode)
+    {
+    case CurrentPosition:
+        return tr("current pointer pos.");
+    case AbsolutePosition:
+        return QString("%1, %2").arg(rule.position.x()).arg(rule.position.y());
+    case RelativePosition:
+        return QString().sprintf("%+d, %+d", rule.position.x(), rule.position.y());
+    }
+    return QString();
+}
+
+
+QString MouseRuleDelegate::intervalText(const MouseRuleData &rule)
+{
+    qint64 ms = rule.interval / 1000000ll;
+    switch (rule.intervalMode)
+    {
+    case MicrosecondsInterval:
+        return QString::fromUtf8("%1 µs").arg(rule.interval / 1000ll);
+    case MillisecondsInterval:
+        return QString("%1 ms").arg(ms);
+    case SecondsInterval:
+        return QString("%1 s").arg(ms / 1000.0, 0, 'f', 1);
+    case MinutesInterval:
+        return QTime::fromMSecsSinceStartOfDay(ms).toString("mm:ss 'm'");
+    case HoursInterval:
+        return QTime::fromMSecsSinceStartOfDay(ms).toString("hh:mm 'h'");
+    }
+    return QString();
+}
+
+
+QString MouseRuleDelegate::actionText(const MouseRuleData &rule)
+{
+    switch (rule.actionMode)
+    {
+    case ButtonAction:
+        return tr("Button %1").arg(rule.action);
+    case KeyAction:
+        return QKeySequence(rule.action).toString();
+    case NoAction:
+        return tr("Do nothing");
+    case BurstAction:
+        return tr("Button %1, %2/s for %3 s").arg(rule.action).arg(rule.burstRate).arg(rule.burstDuration / 1e9, 0, 'f', 1);
+    }
+    return QString();
+}
+
+
+QString MouseRuleDelegate::conditionText(const PixelCondition &condition)
+{
+    return tr("%1,%2 is #%3").arg(condition.position.x()).arg(condition.position.y())
+        .arg(condition.color, 6, 16, QChar('0'));
+}
@@ -0,0 +1,41 @@
+#ifndef MOUSERULEDELEGATE_HPP
+#define MOUSERULEDELEGATE_HPP
+
+#include <QStyledItemDelegate>
+#include "MouseRuleData.hpp"
+
+
+// Paints rule rows and only instantiates a MouseRule editor for the row being edited
+class MouseRuleDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+
+public:
+    explicit MouseRuleDelegate(QObject *parent = 0);
+
+signals:
+    void removeClicked();
+    void addClicked();
+
+public:
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const;
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const;
+    QWidget *createEditor(QWidget *parent, const QStyleOptionViewItem &option, const QModelIndex &index) const;
+    void setEditorData(QWidget *editor, const QModelIndex &index) const;
+    void setModelData(QWidget *editor, QAbstractItemModel *model, const QModelIndex &index) const;
+    void updateEditorGeometry(QWidget *editor, const QStyleOptionViewItem &option, const QModelIndex &index) const;
+
+protected slots:
+    void commitRule();
+
+private:
+    static QString positionText(const MouseRuleData &rule);
+    static QString intervalText(const MouseRuleData &rule);
+    static QString actionText(const MouseRuleData &rule);
+    static QString conditionText(const PixelCondition &condition);
+
+private:
+    QSize mRowSize;
+};
+
+#endif // MOUSERULEDELEGATE_HPP
@@ -0,0 +1,129 @@
+#include "MouseRuleModel.hpp"
+#include "RuleScheduler.hpp"
+#include <algorithm>
+
+
+MouseRuleModel::MouseRuleModel(MouseRuleConfig &config, const RuleScheduler &scheduler, QObject *parent)
+    : QAbstractListModel(parent)
+    , mConfig(config)
+    , mScheduler(scheduler)
+    , mOrigin()
+{
+}
+
+
+int MouseRuleModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : mConfig.rules().size();
+}
+
+
+QVariant MouseRuleModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= mConfig.rules().size())
+    {
+        return QVariant();
+    }
+
+    switch (role)
+    {
+    case RuleRole:
+        return QVariant::fromValue(mConfig.rules()[index.row()]);
+    case ProgressRole:
+        return mScheduler.progress(index.row());
+    case BasePositionRole:
+        return mConfig.absolutePosition(index.row() - 1, mOrigin);
+    case Qt::ToolTipRole:
+        return toolTip(index.row());
+    default:
+        break;
+    }
+    return QVariant();
+}
+
+
+bool MouseRuleModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    if (index.isValid() && role == RuleRole && value.canConvert<MouseRuleData>())
+    {
+        mConfig.setRule(index.row(), value.value<MouseRuleData>());
+        return true;
+    }
+    return false;
+}
+
+
+Qt::ItemFlags MouseRuleModel::flags(const QModelIndex &index) const
+{
+    return QAbstractListModel::flags(index) | Qt::ItemIsEditable;
+}
+
+
+void MouseRuleModel::setOrigin(const QPoint &origin)
+{
+    mOrigin = origin;
+}
+
+
+void MouseRuleModel::updateProgress(int first, int last)
+{
+    // Single row notifications, so an open editor is refreshed as well
+    for (int i = std::max(first, 0); i <= last && i < rowCount(); ++i)
+    {
+        QModelIndex idx(index(i));
+        emit dataChanged(idx, idx, QVector<int>() << ProgressRole);
+    }
+}
+
+
+void MouseRuleModel::ruleAboutToBeAdded(int index)
+{
+    beginInsertRows(QModelIndex(), index, index);
+}
+
+
+void MouseRuleModel::ruleAboutToBeRemoved(int index)
+{
+    beginRemoveRows(QModelIndex(), index, index);
+}
+
+
+void MouseRuleModel::ruleAdded(int /*index*/, const MouseRuleData &/*rule*/)
+{
+    endInsertRows();
+}
+
+
+void MouseRuleModel::ruleChanged(int index, const MouseRuleData &/*rule*/)
+{
+    emit dataChanged(this->index(index), this->index(index));
+
+    // Relative successors move along with this rule
+    if (index + 1 < rowCount())
+    {
+        emit dataChanged(this->index(index + 1), this->index(rowCount() - 1));
+    }
+}
+
+
+void MouseRuleModel::ruleRemoved(int /*index*/)
+{
+    endRemoveRows();
+}
+
+
+QString MouseRuleModel::toolTip(int row) const
+{
+    std::shared_ptr<const FireHistogram> histogram = mScheduler.histogram(row);
+    if (!histogram || histogram->count() == 0)
+    {
+        return tr("Not fired yet");
+    }
+    return tr("Fired %1 times\nMissed deadlines: %2 (> %3 ms late)\nLateness p99: %4 ms, max: %5 ms, jitter: %6 ms")
+        .arg(histogram->count())
+        .arg(histogram->missed())
+        .arg(FireHistogram::MissTolerance / 1000000ll)
+        .arg(histogram->percentile(0.99) / 1e6, 0, 'f', 3)
+        .arg(histogram->maximum() / 1e6, 0, 'f', 3)
+        .arg(histogram->jitter() / 1e6, 0, 'f', 3);
+}
@@ -0,0 +1,51 @@
+#ifndef MOUSERULEMODEL_HPP
+#define MOUSERULEMODEL_HPP
+
+#include <QAbstractListModel>
+#include <QPoint>
+#include "MouseRuleConfig.hpp"
+class RuleScheduler;
+
+
+// List model over the rules of a MouseRuleConfig, one row per rule
+class MouseRuleModel : public QAbstractListModel, public MouseRuleObserver
+{
+    Q_OBJECT
+
+public:
+    enum Roles
+    {
+        RuleRole = Qt::UserRole,
+        ProgressRole,
+        BasePositionRole
+    };
+
+public:
+    MouseRuleModel(MouseRuleConfig &config, const RuleScheduler &scheduler, QObject *parent = 0);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+    bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole);
+    Qt::ItemFlags flags(const QModelIndex &index) const;
+
+    void setOrigin(const QPoint &origin);
+    void updateProgress(int first, int last);
+
+    void ruleAboutToBeAdded(int index);
+    void ruleAboutToBeRemoved(int index);
+    void ruleAdded(int index, const MouseRuleData &rule);
+    void ruleChanged(int index, const MouseRuleData &rule);
+    void ruleRemoved(int index);
+
+private:
+    QString toolTip(int row) const;
+
+private:
+    MouseRuleConfig &mConfig;
+    const RuleScheduler &mScheduler;
+    QPoint mOrigin;
+};
+
+Q_DECLARE_METATYPE(MouseRuleData)
+
+#endif // MOUSERULEMODEL_HPP
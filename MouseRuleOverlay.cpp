@@ -0,0 +1,218 @@
+#include "MouseRuleOverlay.hpp"
+#include <QApplication>
+#include <QFontMetrics>
+#include <QIcon>
+#include <QPainter>
+#include <algorithm>
+
+
+MouseRuleOverlay::MouseRuleOverlay(const MouseRuleConfig &config)
+    : Drawable()
+    , mConfig(config)
+    , mOrigin()
+    , mBounds()
+    , mAtlas()
+    , mCrosshairAbs()
+    , mCrosshairRel()
+    , mDigitAscent(0)
+{
+    buildAtlas();
+}
+
+
+void MouseRuleOverlay::setOrigin(const QPoint &origin)
+{
+    mOrigin = origin;
+    mBounds.clear();
+    updateBounds(0, true);
+    requestRepaint();
+}
+
+
+void MouseRuleOverlay::draw(QPainter &painter, const QRegion &region) const
+{
+    const MouseRules &rules = mConfig.rules();
+    for (int i = 0; i < rules.size() && i < mBounds.size(); ++i)
+    {
+        const MouseRuleData &rule = rules[i];
+        if (rule.positionMode == CurrentPosition || !region.intersects(mBounds[i]))
+        {
+            continue;
+        }
+
+        QPoint pos(mConfig.absolutePosition(i, mOrigin));
+        if (rule.positionMode == AbsolutePosition)
+        {
+            drawMarker(painter, mCrosshairAbs, pos, i);
+        }
+        else
+        {
+            QPoint basePos(mConfig.absolutePosition(i - 1, mOrigin));
+
+            // Draw line
+            QVector<qreal> dashes;
+            dashes << 1 << 4;
+            QPen linePen(Qt::black, 4.0f, Qt::DashLine);
+            linePen.setDashPattern(dashes);
+            linePen.setDashOffset(0.0);
+            painter.setPen(linePen);
+
+            painter.drawLine(basePos, pos);
+
+            linePen.setColor(Qt::white);
+            linePen.setWidthF(2.0f);
+            dashes[0] = 2;
+            dashes[1] = 8;
+            linePen.setDashPattern(dashes);
+            linePen.setDashOffset(0.0);
+            painter.setPen(linePen);
+            painter.drawLine(basePos, pos);
+
+            drawMarker(painter, mCrosshairRel, pos, i);
+        }
+    }
+}
+
+
+void MouseRuleOverlay::ruleAdded(int index, const MouseRuleData &/*rule*/)
+{
+    mBounds.insert(index, QRect());
+    updateBounds(index, index + 1 < mBounds.size());
+}
+
+
+void MouseRuleOverlay::ruleChanged(int index, const MouseRuleData &/*rule*/)
+{
+    updateBounds(index, false);
+}
+
+
+void MouseRuleOverlay::ruleRemoved(int index)
+{
+    QRegion damage;
+    if (index < mBounds.size())
+    {
+        damage += mBounds[index];
+        mBounds.remove(index);
+    }
+    updateBounds(index, true, damage);
+}
+
+
+void MouseRuleOverlay::buildAtlas()
+{
+    QFont font(QApplication::font());
+    font.setPointSize(12);
+    font.setWeight(QFont::DemiBold);
+    QFontMetrics metrics(font);
+    mDigitAscent = metrics.ascent();
+
+    // Layout: both crosshairs, then the ten digits with a 1px outline margin
+    int cellHeight = metrics.height() + 2;
+    int width = 48;
+    for (int d = 0; d < 10; ++d)
+    {
+        mDigits[d] = QRect(width, 0, metrics.width(QChar('0' + d)) + 2, cellHeight);
+        width += mDigits[d].width();
+    }
+    mCrosshairAbs = QRect(0, 0, 24, 24);
+    mCrosshairRel = QRect(24, 0, 24, 24);
+
+    QImage atlas(width, std::max(cellHeight, 24), QImage::Format_ARGB32_Premultiplied);
+    atlas.fill(Qt::transparent);
+    QPainter painter(&atlas);
+    painter.drawPixmap(mCrosshairAbs.topLeft(), QIcon(":/icons/crosshair-select.png").pixmap(QSize(24, 24)));
+    painter.drawPixmap(mCrosshairRel.topLeft(), QIcon(":/icons/crosshair-select2.png").pixmap(QSize(24, 24)));
+    painter.setFont(font);
+    for (int d = 0; d < 10; ++d)
+    {
+        QString digit(QChar('0' + d));
+        QPoint baseline(mDigits[d].left() + 1, mDigitAscent + 1);
+        painter.setPen(Qt::black);
+        for(int x = -1; x < 2; ++x)
+        {
+            for(int y = -1; y < 2; ++y)
+            {
+                painter.drawText(baseline + QPoint(x, y), digit);
+            }
+        }
+        painter.setPen(Qt::white);
+        painter.drawText(baseline, digit);
+    }
+    painter.end();
+    mAtlas = QPixmap::fromImage(atlas);
+}
+
+
+void MouseRuleOverlay::updateBounds(int first, bool isRenumbered, QRegion damage)
+{
+    const MouseRules &rules = mConfig.rules();
+    mBounds.resize(rules.size());
+    for (int i = first; i < rules.size(); ++i)
+    {
+        QRect bounds(markerBounds(i));
+        if (bounds != mBounds[i] || isRenumbered)
+        {
+            damage += mBounds[i];
+            damage += bounds;
+            mBounds[i] = bounds;
+        }
+
+        // Nothing beyond an absolute rule depends on the changed one
+        if (!isRenumbered && i > first && rules[i].positionMode == AbsolutePosition)
+        {
+            break;
+        }
+    }
+    requestRepaint(damage);
+}
+
+
+QRect MouseRuleOverlay::markerBounds(int index) const
+{
+    const MouseRuleData &rule = mConfig.rules()[index];
+    QPoint pos(mConfig.absolutePosition(index, mOrigin));
+    switch (rule.positionMode)
+    {
+    case CurrentPosition:
+        break;
+    case AbsolutePosition:
+        return QRect(pos.x() - 12, pos.y() - 12, 24, 24) | labelRect(pos, index);
+    case RelativePosition:
+    {
+        QPoint basePos(mConfig.absolutePosition(index - 1, mOrigin));
+        QRect line(QRect(basePos, pos).normalized().adjusted(-3, -3, 3, 3));
+        return line | QRect(pos.x() - 12, pos.y() - 12, 24, 24) | labelRect(pos, index);
+    }
+    }
+    return QRect();
+}
+
+
+QRect MouseRuleOverlay::labelRect(const QPoint &pos, int id) const
+{
+    QString number(QString::number(id));
+    int width = 0;
+    for (int c = 0; c < number.size(); ++c)
+    {
+        width += mDigits[number[c].digitValue()].width();
+    }
+    return QRect(pos.x() + 11, pos.y() + 11 - mDigitAscent, width, mDigits[0].height());
+}
+
+
+void MouseRuleOverlay::drawMarker(QPainter &painter, const QRect &crosshair, const QPoint &pos, int id) const
+{
+    // Draw crosshair
+    painter.drawPixmap(QPoint(pos.x() - 12, pos.y() - 12), mAtlas, crosshair);
+
+    // Draw number
+    QString number(QString::number(id));
+    QPoint target(labelRect(pos, id).topLeft());
+    for (int c = 0; c < number.size(); ++c)
+    {
+        const QRect &digit = mDigits[number[c].digitValue()];
+        painter.drawPixmap(target, mAtlas, digit);
+        target.rx() += digit.width();
+    }
+}
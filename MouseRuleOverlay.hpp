@@ -0,0 +1,43 @@
+#ifndef MOUSERULEOVERLAY_HPP
+#define MOUSERULEOVERLAY_HPP
+
+#include <QPixmap>
+#include <QVector>
+#include "GlassWindow.hpp"
+#include "MouseRuleConfig.hpp"
+
+
+// Draws the position markers of all rules onto the glass window. Tracks the
+// bounding rect of every marker so only damaged areas are repainted, and
+// blits crosshairs and outlined digits from a pre-rendered atlas.
+class MouseRuleOverlay : public Drawable, public MouseRuleObserver
+{
+public:
+    explicit MouseRuleOverlay(const MouseRuleConfig &config);
+
+    void setOrigin(const QPoint &origin);
+    void draw(QPainter &painter, const QRegion &region) const;
+
+    void ruleAdded(int index, const MouseRuleData &rule);
+    void ruleChanged(int index, const MouseRuleData &rule);
+    void ruleRemoved(int index);
+
+private:
+    void buildAtlas();
+    void updateBounds(int first, bool isRenumbered, QRegion damage = QRegion());
+    QRect markerBounds(int index) const;
+    QRect labelRect(const QPoint &pos, int id) const;
+    void drawMarker(QPainter &painter, const QRect &crosshair, const QPoint &pos, int id) const;
+
+private:
+    const MouseRuleConfig &mConfig;
+    QPoint mOrigin;
+    QVector<QRect> mBounds;
+    QPixmap mAtlas;
+    QRect mCrosshairAbs;
+    QRect mCrosshairRel;
+    QRect mDigits[10];
+    int mDigitAscent;
+};
+
+#endif // MOUSERULEOVERLAY_HPP
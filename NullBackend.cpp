@@ -0,0 +1,65 @@
+#include "NullBackend.hpp"
+
+
+NullBackend::NullBackend(const QSize &screenSize)
+    : MouseRobotBackend()
+{
+    mScreenSize = screenSize;
+    mPointer = QPoint(screenSize.width() / 2, screenSize.height() / 2);
+}
+
+
+const char *NullBackend::name() const
+{
+    return "null";
+}
+
+
+bool NullBackend::open(quintptr /*parentWindow*/)
+{
+    return true;
+}
+
+
+void NullBackend::close()
+{
+}
+
+
+bool NullBackend::prepare()
+{
+    return true;
+}
+
+
+QRect NullBackend::ownWindow()
+{
+    return QRect();
+}
+
+
+void NullBackend::fakeMotion(const QPoint &/*position*/, unsigned long /*delay*/)
+{
+}
+
+
+void NullBackend::fakeButton(quint32 /*button*/, bool /*isPress*/, unsigned long /*delay*/)
+{
+}
+
+
+void NullBackend::fakeKey(quint8 /*keyCode*/, bool /*isPress*/, unsigned long /*delay*/)
+{
+}
+
+
+void NullBackend::flush()
+{
+}
+
+
+unsigned long NullBackend::typeKey(quint32 /*keySym*/, quint32 modifiers, unsigned long /*delay*/, quint64 &events)
+{
+    events += keyEventCount(modifiers);
+    return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef NULLBACKEND_HPP
+#define NULLBACKEND_HPP
+
+#include "MouseRobotBackend.hpp"
+
+
+// Discards every event, for measuring the engine without any X server
+class NullBackend : public MouseRobotBackend
+{
+public:
+    explicit NullBackend(const QSize &screenSize = QSize(1920, 1080));
+
+public:
+    const char *name() const;
+    bool open(quintptr parentWindow);
+    void close();
+
+protected:
+    bool prepare();
+    QRect ownWindow();
+    void fakeMotion(const QPoint &position, unsigned long delay);
+    void fakeButton(quint32 button, bool isPress, unsigned long delay);
+    void fakeKey(quint8 keyCode, bool isPress, unsigned long delay);
+    void flush();
+    unsigned long typeKey(quint32 keySym, quint32 modifiers, unsigned long delay, quint64 &events);
+};
+
+#endif // NULLBACKEND_HPP
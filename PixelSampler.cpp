@@ -0,0 +1,451 @@
+#include "PixelSampler.hpp"
+#include <QRect>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <string.h>
+#include <algorithm>
+#include <cstdlib>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+// A pixel joins a capture if that grows its rectangle by at most this many pixels
+const qint64 MergeSlack = 4096;
+
+
+struct Capture
+{
+    QRect rect;
+    XImage *image;
+    XShmSegmentInfo shm;
+    bool isShm;
+};
+
+
+qint64 area(const QRect &rect)
+{
+    return qint64(rect.width()) * rect.height();
+}
+
+
+// Tolerance in each color channel byte
+quint32 channelTolerance(quint32 tolerance)
+{
+    quint32 t = std::min(tolerance, 255u);
+    return t << 16 | t << 8 | t;
+}
+
+
+// Errors of one display are recorded while a trap exists, instead of the
+// default handler ending the process. Others go to the previous handler.
+Display *trappedDisplay = NULL;
+int trappedError = Success;
+XErrorHandler previousHandler = NULL;
+
+
+int trapError(Display *display, XErrorEvent *event)
+{
+    if (display == trappedDisplay)
+    {
+        trappedError = event->error_code;
+        return 0;
+    }
+    return previousHandler ? previousHandler(display, event) : 0;
+}
+
+
+class ErrorTrap
+{
+public:
+    explicit ErrorTrap(Display *display)
+    {
+        trappedDisplay = display;
+        trappedError = Success;
+        previousHandler = XSetErrorHandler(trapError);
+    }
+
+    ~ErrorTrap()
+    {
+        XSetErrorHandler(previousHandler);
+        trappedDisplay = NULL;
+    }
+
+    // Errors of requests whose reply has arrived, XSync() first for the others
+    bool isFailed() const
+    {
+        return trappedError != Success;
+    }
+};
+}
+
+
+class PixelSampler::PixelSamplerImpl
+{
+public:
+    PixelSamplerImpl()
+        : mDisplay(XOpenDisplay(NULL))
+        , mRoot(0)
+        , mIsShm(false)
+        , mScreen()
+        , mConditions()
+        , mCaptures()
+        , mPixelCaptures()
+        , mSamples()
+        , mColors()
+        , mTolerances()
+        , mMatches()
+    {
+        if (!mDisplay)
+        {
+            qWarning("PixelSampler: cannot open display, pixel conditions never match");
+            return;
+        }
+        mRoot = DefaultRootWindow(mDisplay);
+        updateScreen();
+        // Shared memory only works with a local X server
+        const char *name = DisplayString(mDisplay);
+        mIsShm = XShmQueryExtension(mDisplay) && name && name[0] == ':';
+        qDebug("PixelSampler: capturing with %s", mIsShm ? "MIT-SHM" : "XGetImage");
+    }
+
+
+    ~PixelSamplerImpl()
+    {
+        freeCaptures();
+        if (mDisplay)
+        {
+            XCloseDisplay(mDisplay);
+            mDisplay = NULL;
+        }
+    }
+
+
+    void setConditions(const std::vector<PixelCondition> &conditions)
+    {
+        freeCaptures();
+        mConditions = conditions;
+        size_t count = conditions.size();
+        mPixelCaptures.assign(count, -1);
+        mSamples.assign(count, 0u);
+        mColors.assign(count, 0u);
+        mTolerances.assign(count, 0u);
+        mMatches.assign(count, 0u);
+
+        // Group the watched pixels into few small rectangles
+        std::vector<QRect> rects;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const PixelCondition &condition = conditions[i];
+            mColors[i] = condition.color & 0xFFFFFFu;
+            mTolerances[i] = channelTolerance(condition.tolerance);
+            if (!condition.isEnabled || !mScreen.contains(condition.position))
+            {
+                continue;
+            }
+            QRect pixel(condition.position, QSize(1, 1));
+            size_t r = 0;
+            while (r < rects.size() && area(rects[r].united(pixel)) - area(rects[r]) > MergeSlack)
+            {
+                ++r;
+            }
+            if (r == rects.size())
+            {
+                rects.push_back(pixel);
+            }
+            else
+            {
+                rects[r] = rects[r].united(pixel);
+            }
+            mPixelCaptures[i] = static_cast<int>(r);
+        }
+
+        if (!mDisplay)
+        {
+            return;
+        }
+        for (auto r = rects.begin(); r != rects.end(); ++r)
+        {
+            mCaptures.push_back(createCapture(*r));
+        }
+        qDebug("PixelSampler: %d conditions in %d captures", static_cast<int>(count), static_cast<int>(rects.size()));
+    }
+
+
+    bool sample()
+    {
+        if (!mDisplay)
+        {
+            return false;
+        }
+        bool isCaptured = true;
+        {
+            ErrorTrap trap(mDisplay);
+            for (auto r = mCaptures.begin(); r != mCaptures.end(); ++r)
+            {
+                if (!r->image)
+                {
+                    continue;
+                }
+                if (r->isShm)
+                {
+                    isCaptured = XShmGetImage(mDisplay, mRoot, r->image, r->rect.x(), r->rect.y(), AllPlanes) && isCaptured;
+                }
+                else
+                {
+                    isCaptured = XGetSubImage(mDisplay, mRoot, r->rect.x(), r->rect.y(), r->rect.width(), r->rect.height(),
+                                              AllPlanes, ZPixmap, r->image, 0, 0) && isCaptured;
+                }
+            }
+            isCaptured = isCaptured && !trap.isFailed();
+        }
+        if (!isCaptured)
+        {
+            recover();
+            return false;
+        }
+
+        // Gather one sample per condition, then compare them all in one go
+        for (size_t i = 0; i < mConditions.size(); ++i)
+        {
+            int r = mPixelCaptures[i];
+            const XImage *image = r >= 0 ? mCaptures[r].image : NULL;
+            if (!image)
+            {
+                continue;
+            }
+            int x = mConditions[i].position.x() - mCaptures[r].rect.x();
+            int y = mConditions[i].position.y() - mCaptures[r].rect.y();
+            if (image->bits_per_pixel == 32)
+            {
+                const char *row = image->data + y * image->bytes_per_line;
+                quint32 pixel;
+                memcpy(&pixel, row + x * 4, sizeof(pixel));
+                mSamples[i] = pixel & 0xFFFFFFu;
+            }
+            else
+            {
+                mSamples[i] = XGetPixel(const_cast<XImage*>(image), x, y) & 0xFFFFFFu;
+            }
+        }
+        compare(mSamples.data(), mColors.data(), mTolerances.data(), mMatches.data(), mConditions.size());
+        for (size_t i = 0; i < mConditions.size(); ++i)
+        {
+            // Off screen or not captured
+            int r = mPixelCaptures[i];
+            if (r < 0 || !mCaptures[r].image)
+            {
+                mMatches[i] = 0;
+            }
+        }
+        return true;
+    }
+
+
+    // A capture fails if the screen shrank under it (RandR), else shared
+    // memory or the capture as a whole does not work on this server
+    void recover()
+    {
+        QRect screen = mScreen;
+        updateScreen();
+        if (mScreen != screen)
+        {
+            qWarning("PixelSampler: screen changed to %dx%d", mScreen.width(), mScreen.height());
+        }
+        else if (mIsShm)
+        {
+            qWarning("PixelSampler: MIT-SHM capture failed, using XGetImage");
+            mIsShm = false;
+        }
+        else
+        {
+            qWarning("PixelSampler: cannot capture the screen, pixel conditions never match");
+            freeCaptures();
+            XCloseDisplay(mDisplay);
+            mDisplay = NULL;
+            return;
+        }
+        std::vector<PixelCondition> conditions(mConditions);
+        setConditions(conditions);
+    }
+
+
+    void updateScreen()
+    {
+        // Asks the server, the size cached in the display is not updated by RandR
+        Window root;
+        int x, y;
+        unsigned int width, height, border, depth;
+        if (XGetGeometry(mDisplay, mRoot, &root, &x, &y, &width, &height, &border, &depth))
+        {
+            mScreen = QRect(0, 0, static_cast<int>(width), static_cast<int>(height));
+        }
+    }
+
+
+    Capture createCapture(const QRect &rect)
+    {
+        Capture capture;
+        capture.rect = rect;
+        capture.image = NULL;
+        capture.isShm = false;
+        memset(&capture.shm, 0, sizeof(capture.shm));
+        int screen = DefaultScreen(mDisplay);
+        if (mIsShm)
+        {
+            XImage *image = XShmCreateImage(mDisplay, DefaultVisual(mDisplay, screen), DefaultDepth(mDisplay, screen),
+                                            ZPixmap, NULL, &capture.shm, rect.width(), rect.height());
+            if (image)
+            {
+                capture.shm.shmid = shmget(IPC_PRIVATE, image->bytes_per_line * image->height, IPC_CREAT | 0600);
+                capture.shm.shmaddr = capture.shm.shmid >= 0 ? static_cast<char*>(shmat(capture.shm.shmid, NULL, 0)) : reinterpret_cast<char*>(-1);
+                bool isAttached = false;
+                if (capture.shm.shmaddr != reinterpret_cast<char*>(-1))
+                {
+                    image->data = capture.shm.shmaddr;
+                    capture.shm.readOnly = False;
+                    // Fails if the server cannot see the segment, e.g. in another IPC namespace
+                    ErrorTrap trap(mDisplay);
+                    isAttached = XShmAttach(mDisplay, &capture.shm);
+                    XSync(mDisplay, False);
+                    isAttached = isAttached && !trap.isFailed();
+                }
+                if (capture.shm.shmid >= 0)
+                {
+                    // Removed once both sides have detached
+                    shmctl(capture.shm.shmid, IPC_RMID, NULL);
+                }
+                if (isAttached)
+                {
+                    capture.image = image;
+                    capture.isShm = true;
+                    return capture;
+                }
+                if (capture.shm.shmaddr != reinterpret_cast<char*>(-1))
+                {
+                    qWarning("PixelSampler: cannot attach shared memory, using XGetImage");
+                    mIsShm = false;
+                    shmdt(capture.shm.shmaddr);
+                    image->data = NULL;
+                }
+                XDestroyImage(image);
+            }
+        }
+        ErrorTrap trap(mDisplay);
+        capture.image = XGetImage(mDisplay, mRoot, rect.x(), rect.y(), rect.width(), rect.height(), AllPlanes, ZPixmap);
+        return capture;
+    }
+
+
+    void freeCaptures()
+    {
+        for (auto r = mCaptures.begin(); r != mCaptures.end(); ++r)
+        {
+            if (r->isShm)
+            {
+                XShmDetach(mDisplay, &r->shm);
+                XSync(mDisplay, False);
+                shmdt(r->shm.shmaddr);
+                r->image->data = NULL;
+            }
+            if (r->image)
+            {
+                XDestroyImage(r->image);
+            }
+        }
+        mCaptures.clear();
+    }
+
+
+    Display *mDisplay;
+    Window mRoot;
+    bool mIsShm;
+    QRect mScreen;
+    std::vector<PixelCondition> mConditions;
+    std::vector<Capture> mCaptures;
+    // Capture of each condition, -1 if off screen
+    std::vector<int> mPixelCaptures;
+    std::vector<quint32> mSamples;
+    std::vector<quint32> mColors;
+    std::vector<quint32> mTolerances;
+    std::vector<quint8> mMatches;
+};
+
+
+PixelSampler::PixelSampler()
+    : mImpl(new PixelSamplerImpl())
+{
+}
+
+
+PixelSampler::~PixelSampler()
+{
+    if (mImpl)
+    {
+        delete mImpl;
+        mImpl = 0;
+    }
+}
+
+
+void PixelSampler::setConditions(const std::vector<PixelCondition> &conditions)
+{
+    mImpl->setConditions(conditions);
+}
+
+
+const std::vector<PixelCondition> &PixelSampler::conditions() const
+{
+    return mImpl->mConditions;
+}
+
+
+bool PixelSampler::sample()
+{
+    return mImpl->sample();
+}
+
+
+bool PixelSampler::matches(int index) const
+{
+    return index >= 0 && index < static_cast<int>(mImpl->mMatches.size()) && mImpl->mMatches[index] != 0;
+}
+
+
+void PixelSampler::compare(const quint32 *samples, const quint32 *colors, const quint32 *tolerances,
+                           quint8 *matches, size_t count)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    // Four pixels at a time: saturated differences in both directions give
+    // |sample - color| per byte, which must not exceed the tolerance byte
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(colors + i));
+        __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tolerances + i));
+        __m128i d = _mm_or_si128(_mm_subs_epu8(s, c), _mm_subs_epu8(c, s));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(d, t), t));
+        matches[i] = (mask & 0x000F) == 0x000F;
+        matches[i + 1] = (mask & 0x00F0) == 0x00F0;
+        matches[i + 2] = (mask & 0x0F00) == 0x0F00;
+        matches[i + 3] = (mask & 0xF000) == 0xF000;
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        bool isMatch = true;
+        for (int shift = 0; shift < 24; shift += 8)
+        {
+            int s = (samples[i] >> shift) & 0xFF;
+            int c = (colors[i] >> shift) & 0xFF;
+            int t = (tolerances[i] >> shift) & 0xFF;
+            isMatch = isMatch && std::abs(s - c) <= t;
+        }
+        matches[i] = isMatch;
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef PIXELSAMPLER_HPP
+#define PIXELSAMPLER_HPP
+
+#include <QtGlobal>
+#include <vector>
+#include "MouseRuleData.hpp"
+
+
+// Samples the screen pixels of rule conditions. Watched pixels are grouped
+// into a few rectangles, each captured with XShmGetImage into a persistent
+// shared memory segment (XGetSubImage without MIT-SHM), so a sample costs
+// one request per rectangle instead of one per pixel. All conditions are
+// then compared at once. Owned by a single thread.
+class PixelSampler
+{
+public:
+    PixelSampler();
+    ~PixelSampler();
+
+    // Replaces the watched conditions, matches() takes indices into them
+    void setConditions(const std::vector<PixelCondition> &conditions);
+    const std::vector<PixelCondition> &conditions() const;
+    // Captures the screen and compares every condition. False without a
+    // display or if the capture failed, e.g. because the screen shrank;
+    // the next sample() captures the screen as it is now.
+    bool sample();
+    bool matches(int index) const;
+
+    // For count 0x00RRGGBB pixels: every channel of |sample - color| is at most
+    // the same channel of tolerance
+    static void compare(const quint32 *samples, const quint32 *colors, const quint32 *tolerances,
+                        quint8 *matches, size_t count);
+
+private:
+    class PixelSamplerImpl;
+    PixelSamplerImpl *mImpl;
+};
+
+#endif // PIXELSAMPLER_HPP
@@ -0,0 +1,126 @@
+#include "RecordingBackend.hpp"
+#include <ctime>
+#include <algorithm>
+
+
+namespace
+{
+// Same clock as RuleScheduler::now(), without depending on the scheduler
+qint64 now()
+{
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return static_cast<qint64>(time.tv_sec) * 1000000000ll + time.tv_nsec;
+}
+}
+
+
+RecordingBackend::RecordingBackend(int capacity, const QSize &screenSize)
+    : MouseRobotBackend()
+    , mMutex()
+    , mRecords(std::max(capacity, 1))
+    , mWriteCount(0)
+{
+    mScreenSize = screenSize;
+    mPointer = QPoint(screenSize.width() / 2, screenSize.height() / 2);
+}
+
+
+const char *RecordingBackend::name() const
+{
+    return "record";
+}
+
+
+bool RecordingBackend::open(quintptr /*parentWindow*/)
+{
+    return true;
+}
+
+
+void RecordingBackend::close()
+{
+}
+
+
+quint64 RecordingBackend::recordCount() const
+{
+    return mWriteCount.load(std::memory_order_acquire);
+}
+
+
+std::vector<RecordingBackend::Record> RecordingBackend::records() const
+{
+    // The writer waits for the copy, so no record changes halfway through
+    QMutexLocker locker(&mMutex);
+    quint64 capacity = mRecords.size();
+    quint64 end = mWriteCount.load(std::memory_order_relaxed);
+    quint64 begin = end > capacity ? end - capacity : 0;
+    std::vector<Record> result;
+    result.reserve(end - begin);
+    for (quint64 i = begin; i < end; ++i)
+    {
+        result.push_back(mRecords[i % capacity]);
+    }
+    return result;
+}
+
+
+bool RecordingBackend::prepare()
+{
+    return true;
+}
+
+
+QRect RecordingBackend::ownWindow()
+{
+    return QRect();
+}
+
+
+void RecordingBackend::fakeMotion(const QPoint &position, unsigned long delay)
+{
+    record(Record::Motion, position, 0, 0, delay);
+}
+
+
+void RecordingBackend::fakeButton(quint32 button, bool isPress, unsigned long delay)
+{
+    record(isPress ? Record::ButtonPress : Record::ButtonRelease, mPointer, button, 0, delay);
+}
+
+
+void RecordingBackend::fakeKey(quint8 /*keyCode*/, bool /*isPress*/, unsigned long /*delay*/)
+{
+    // Keys are recorded whole in typeKey
+}
+
+
+void RecordingBackend::flush()
+{
+}
+
+
+unsigned long RecordingBackend::typeKey(quint32 keySym, quint32 modifiers, unsigned long delay, quint64 &events)
+{
+    record(Record::Key, mPointer, keySym, modifiers, delay);
+    events += keyEventCount(modifiers);
+    return 0;
+}
+
+
+void RecordingBackend::record(Record::Type type, const QPoint &position, quint32 value, quint32 modifiers, unsigned long delay)
+{
+    // Single writer (the injection thread), readers only contend in records()
+    QMutexLocker locker(&mMutex);
+    quint64 index = mWriteCount.load(std::memory_order_relaxed);
+    Record &r = mRecords[index % mRecords.size()];
+    r.time = now();
+    r.delay = static_cast<quint32>(delay);
+    r.type = type;
+    r.x = position.x();
+    r.y = position.y();
+    r.value = value;
+    r.modifiers = modifiers;
+    mWriteCount.store(index + 1, std::memory_order_release);
+}
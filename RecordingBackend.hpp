@@ -0,0 +1,66 @@
+#ifndef RECORDINGBACKEND_HPP
+#define RECORDINGBACKEND_HPP
+
+#include "MouseRobotBackend.hpp"
+#include <QMutex>
+#include <atomic>
+
+
+// Records every event with its CLOCK_MONOTONIC time instead of sending it.
+// The ring buffer is allocated up front and overwrites the oldest records,
+// so recording costs the same for any rule count. Each record is written
+// under an uncontended lock that records() takes for its snapshot. Keys are
+// recorded as keysym plus modifiers since there is no keyboard mapping.
+class RecordingBackend : public MouseRobotBackend
+{
+public:
+    struct Record
+    {
+        enum Type
+        {
+            Motion,
+            ButtonPress,
+            ButtonRelease,
+            Key
+        };
+
+        qint64 time;
+        quint32 delay;
+        Type type;
+        qint32 x;
+        qint32 y;
+        quint32 value;
+        quint32 modifiers;
+    };
+
+public:
+    explicit RecordingBackend(int capacity = 65536, const QSize &screenSize = QSize(1920, 1080));
+
+public:
+    const char *name() const;
+    bool open(quintptr parentWindow);
+    void close();
+
+    // Safe from any thread while recording goes on, oldest first
+    quint64 recordCount() const;
+    std::vector<Record> records() const;
+
+protected:
+    bool prepare();
+    QRect ownWindow();
+    void fakeMotion(const QPoint &position, unsigned long delay);
+    void fakeButton(quint32 button, bool isPress, unsigned long delay);
+    void fakeKey(quint8 keyCode, bool isPress, unsigned long delay);
+    void flush();
+    unsigned long typeKey(quint32 keySym, quint32 modifiers, unsigned long delay, quint64 &events);
+
+private:
+    void record(Record::Type type, const QPoint &position, quint32 value, quint32 modifiers, unsigned long delay);
+
+private:
+    mutable QMutex mMutex;
+    std::vector<Record> mRecords;
+    std::atomic<quint64> mWriteCount;
+};
+
+#endif // RECORDINGBACKEND_HPP
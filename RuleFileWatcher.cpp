@@ -0,0 +1,126 @@
+#include "RuleFileWatcher.hpp"
+#include "BinaryRuleFile.hpp"
+#include "RuleJournal.hpp"
+#include <QFile>
+#include <QFileInfo>
+
+
+RuleFileWatcher::RuleFileWatcher(MouseRuleConfig &config, const QString &fileName, RuleJournal *journal, QObject *parent)
+    : QThread(parent)
+    , mConfig(config)
+    , mFileName(QFileInfo(fileName).absoluteFilePath())
+    , mJournal(journal)
+    , mWatcher()
+    , mSettleTimer()
+    , mIsReloadPending(false)
+    , mIsLoaded(false)
+    , mChecksum(0)
+    , mSettings()
+    , mRules()
+{
+    // Files replaced by rename drop out of the watch, the directory brings them back
+    mWatcher.addPath(QFileInfo(mFileName).absolutePath());
+    if (QFile::exists(mFileName))
+    {
+        mWatcher.addPath(mFileName);
+    }
+    mSettleTimer.setSingleShot(true);
+    mSettleTimer.setInterval(SettleDelay);
+
+    connect(&mWatcher, SIGNAL(fileChanged(QString)), this, SLOT(fileChanged()));
+    connect(&mWatcher, SIGNAL(directoryChanged(QString)), this, SLOT(directoryChanged()));
+    connect(&mSettleTimer, SIGNAL(timeout()), this, SLOT(reload()));
+    connect(this, SIGNAL(finished()), this, SLOT(apply()));
+}
+
+
+RuleFileWatcher::~RuleFileWatcher()
+{
+    wait();
+}
+
+
+void RuleFileWatcher::run()
+{
+    mIsLoaded = false;
+    QFile file(mFileName);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return;
+    }
+    // Checksum and rules come from the same read, so they always match
+    QByteArray data = file.readAll();
+    mChecksum = BinaryRuleFile::checksum(reinterpret_cast<const uchar*>(data.constData()), data.size());
+    if (mJournal && mChecksum == mJournal->fileChecksum())
+    {
+        return;
+    }
+
+    // A file that does not parse is most likely still being written
+    MouseRuleConfig loaded;
+    if (loaded.load(data, mFileName))
+    {
+        mSettings = loaded.settings();
+        mRules = loaded.rules();
+        mIsLoaded = true;
+    }
+}
+
+
+void RuleFileWatcher::fileChanged()
+{
+    // A removed file comes back through the directory
+    if (QFile::exists(mFileName))
+    {
+        if (!mWatcher.files().contains(mFileName))
+        {
+            mWatcher.addPath(mFileName);
+        }
+        mSettleTimer.start();
+    }
+}
+
+
+void RuleFileWatcher::directoryChanged()
+{
+    // Only matters when it brings back the file
+    if (!mWatcher.files().contains(mFileName) && QFile::exists(mFileName))
+    {
+        mWatcher.addPath(mFileName);
+        mSettleTimer.start();
+    }
+}
+
+
+void RuleFileWatcher::reload()
+{
+    if (isRunning())
+    {
+        mIsReloadPending = true;
+        return;
+    }
+    start();
+}
+
+
+void RuleFileWatcher::apply()
+{
+    // finished() is sent just before the thread ends
+    wait();
+    if (mIsLoaded)
+    {
+        qDebug("RuleFileWatcher: %s changed", qPrintable(mFileName));
+        mConfig.update(mSettings, mRules);
+        mRules.clear();
+        mIsLoaded = false;
+        if (mJournal)
+        {
+            mJournal->requestCompaction(mChecksum);
+        }
+    }
+    if (mIsReloadPending)
+    {
+        mIsReloadPending = false;
+        start();
+    }
+}
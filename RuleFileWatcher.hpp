@@ -0,0 +1,53 @@
+#ifndef RULEFILEWATCHER_HPP
+#define RULEFILEWATCHER_HPP
+
+#include <QThread>
+#include <QFileSystemWatcher>
+#include <QTimer>
+#include "MouseRuleConfig.hpp"
+class RuleJournal;
+
+
+// Reloads a rule file when it changes on disk (inotify through
+// QFileSystemWatcher). The file is parsed on this thread and the result is
+// diff-applied to the config on the config's thread, so unchanged rules
+// keep their timers and statistics. Files the journal wrote itself are not
+// reloaded, and a reload makes the journal compact onto the new file.
+class RuleFileWatcher : public QThread
+{
+    Q_OBJECT
+
+public:
+    enum
+    {
+        // Lets writers finish before the file is read
+        SettleDelay = 200 // ms
+    };
+
+    RuleFileWatcher(MouseRuleConfig &config, const QString &fileName, RuleJournal *journal = 0, QObject *parent = 0);
+    ~RuleFileWatcher();
+
+protected:
+    void run();
+
+private slots:
+    void fileChanged();
+    void directoryChanged();
+    void reload();
+    void apply();
+
+private:
+    MouseRuleConfig &mConfig;
+    QString mFileName;
+    RuleJournal *mJournal;
+    QFileSystemWatcher mWatcher;
+    QTimer mSettleTimer;
+    bool mIsReloadPending;
+    // Written by the thread, read once it has finished
+    bool mIsLoaded;
+    quint32 mChecksum;
+    MouseRuleSettings mSettings;
+    MouseRules mRules;
+};
+
+#endif // RULEFILEWATCHER_HPP
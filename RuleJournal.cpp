@@ -0,0 +1,429 @@
+#include "RuleJournal.hpp"
+#include "BinaryRuleFile.hpp"
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    const char Magic[4] = { 'A', 'C', 'R', 'J' };
+
+
+    QByteArray encode(const RuleJournal::Edit &edit)
+    {
+        QByteArray payload;
+        QDataStream stream(&payload, QIODevice::WriteOnly);
+        stream << quint8(edit.type) << qint32(edit.index);
+        if (edit.type == RuleJournal::Edit::AddRule || edit.type == RuleJournal::Edit::ChangeRule)
+        {
+            const MouseRuleData &rule = edit.rule;
+            stream << rule.position << qint32(rule.positionMode) << qint64(rule.interval)
+                   << qint32(rule.intervalMode) << quint32(rule.action) << qint32(rule.actionMode)
+                   << quint32(rule.burstRate) << qint64(rule.burstDuration)
+                   << rule.condition.isEnabled << rule.condition.position << quint32(rule.condition.color)
+                   << quint32(rule.condition.tolerance);
+        }
+        else if (edit.type == RuleJournal::Edit::ChangeSettings)
+        {
+            const MouseRuleSettings &settings = edit.settings;
+            stream << qint32(settings.catchUpPolicy) << qint32(settings.motion.path) << quint32(settings.motion.rate) << qint64(settings.motion.duration);
+        }
+        return payload;
+    }
+
+
+    bool decode(const QByteArray &payload, RuleJournal::Edit &edit)
+    {
+        QDataStream stream(payload);
+        quint8 type(0);
+        qint32 index(0);
+        stream >> type >> index;
+        edit.type = RuleJournal::Edit::Type(type);
+        edit.index = index;
+        if (edit.type == RuleJournal::Edit::AddRule || edit.type == RuleJournal::Edit::ChangeRule)
+        {
+            MouseRuleData &rule = edit.rule;
+            qint32 positionMode(0), intervalMode(0), actionMode(0);
+            qint64 interval(0), burstDuration(0);
+            quint32 action(0), burstRate(0);
+            stream >> rule.position >> positionMode >> interval >> intervalMode >> action >> actionMode
+                   >> burstRate >> burstDuration >> rule.condition.isEnabled >> rule.condition.position
+                   >> rule.condition.color >> rule.condition.tolerance;
+            rule.positionMode = EPositionMode(positionMode);
+            rule.interval = interval;
+            rule.intervalMode = EIntervalMode(intervalMode);
+            rule.action = action;
+            rule.actionMode = EActionMode(actionMode);
+            rule.burstRate = burstRate;
+            rule.burstDuration = burstDuration;
+        }
+        else if (edit.type == RuleJournal::Edit::ChangeSettings)
+        {
+            MouseRuleSettings &settings = edit.settings;
+            qint32 catchUpPolicy(0), path(0);
+            quint32 rate(0);
+            qint64 duration(0);
+            stream >> catchUpPolicy >> path >> rate >> duration;
+            settings.catchUpPolicy = ECatchUpPolicy(catchUpPolicy);
+            settings.motion.path = MouseRobot::MotionPath(path);
+            settings.motion.rate = rate;
+            settings.motion.duration = duration;
+        }
+        else if (edit.type != RuleJournal::Edit::RemoveRule)
+        {
+            return false;
+        }
+        return stream.status() == QDataStream::Ok;
+    }
+
+
+    // Same effect on the copy as MouseRuleConfig has on its rules
+    void apply(const RuleJournal::Edit &edit, MouseRuleSettings &settings, MouseRules &rules)
+    {
+        switch (edit.type)
+        {
+        case RuleJournal::Edit::AddRule:
+            rules.insert(std::min(std::max(edit.index, 0), rules.size()), edit.rule);
+            break;
+        case RuleJournal::Edit::ChangeRule:
+            if (edit.index >= 0 && edit.index < rules.size())
+            {
+                rules[edit.index] = edit.rule;
+            }
+            break;
+        case RuleJournal::Edit::RemoveRule:
+            if (edit.index >= 0 && edit.index < rules.size())
+            {
+                rules.remove(edit.index);
+            }
+            break;
+        case RuleJournal::Edit::ChangeSettings:
+            settings = edit.settings;
+            break;
+        }
+    }
+
+
+    quint32 checksumOf(const QString &fileName)
+    {
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            return 0;
+        }
+        QByteArray data = file.readAll();
+        return BinaryRuleFile::checksum(reinterpret_cast<const uchar*>(data.constData()), data.size());
+    }
+}
+
+
+RuleJournal::RuleJournal(const QString &fileName, QObject *parent)
+    : QThread(parent)
+    , mFileName(fileName)
+    , mJournalName(fileName + ".journal")
+    , mMutex()
+    , mCondition()
+    , mEdits()
+    , mIsStopping(false)
+    , mIsCompactRequested(false)
+    , mFileChecksum(0)
+    , mSettings()
+    , mRules()
+    , mIsCompactDue(false)
+    , mIsJournalStale(false)
+{
+}
+
+
+RuleJournal::~RuleJournal()
+{
+    QMutexLocker locker(&mMutex);
+    mIsStopping = true;
+    mCondition.wakeOne();
+    locker.unlock();
+    wait();
+}
+
+
+QString RuleJournal::defaultFileName()
+{
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::AppConfigLocation)).filePath("mouse_rules.ini");
+}
+
+
+const QString &RuleJournal::fileName() const
+{
+    return mFileName;
+}
+
+
+quint32 RuleJournal::fileChecksum() const
+{
+    QMutexLocker locker(&mMutex);
+    return mFileChecksum;
+}
+
+
+void RuleJournal::requestCompaction(quint32 fileChecksum)
+{
+    QMutexLocker locker(&mMutex);
+    mFileChecksum = fileChecksum;
+    mIsCompactRequested = true;
+    mCondition.wakeOne();
+}
+
+
+void RuleJournal::restore(MouseRuleConfig &config)
+{
+    QDir().mkpath(QFileInfo(mFileName).absolutePath());
+    bool isFound = QFile::exists(mFileName);
+    MouseRuleConfig snapshot;
+    if (isFound)
+    {
+        snapshot.load(mFileName);
+    }
+    else
+    {
+        snapshot.reset(MouseRuleSettings(), MouseRules());
+    }
+    mSettings = snapshot.settings();
+    mRules = snapshot.rules();
+
+    // Without the file there is nothing the journal could extend
+    mFileChecksum = isFound ? checksumOf(mFileName) : 0;
+    int count = isFound ? replay(mFileChecksum) : -1;
+    if (count > 0)
+    {
+        qDebug("RuleJournal: restored %d edits from %s", count, qPrintable(mJournalName));
+    }
+    mIsCompactDue = !isFound || count > 0;
+    mIsJournalStale = count < 0;
+
+    config.reset(mSettings, mRules);
+    config.addObserver(this);
+    start();
+}
+
+
+void RuleJournal::ruleAdded(int index, const MouseRuleData &rule)
+{
+    Edit edit = { Edit::AddRule, index, rule, MouseRuleSettings() };
+    push(edit);
+}
+
+
+void RuleJournal::ruleChanged(int index, const MouseRuleData &rule)
+{
+    Edit edit = { Edit::ChangeRule, index, rule, MouseRuleSettings() };
+    push(edit);
+}
+
+
+void RuleJournal::ruleRemoved(int index)
+{
+    Edit edit = { Edit::RemoveRule, index, MouseRuleData(), MouseRuleSettings() };
+    push(edit);
+}
+
+
+void RuleJournal::settingsChanged(const MouseRuleSettings &settings)
+{
+    Edit edit = { Edit::ChangeSettings, 0, MouseRuleData(), settings };
+    push(edit);
+}
+
+
+void RuleJournal::run()
+{
+    QFile journal(mJournalName);
+    // Edits not in the file yet, a refused compaction is retried like them
+    int journalEdits = 0;
+    if (mIsCompactDue && !compact(journal))
+    {
+        journalEdits = 1;
+    }
+    // A successful compaction has restarted the journal already
+    if (!journal.isOpen() && mIsJournalStale)
+    {
+        // Not the file on disk, which may have changed since it was restored
+        restart(journal, fileChecksum());
+    }
+    else if (!journal.isOpen() && !journal.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        qWarning("RuleJournal: cannot open %s: %s", qPrintable(mJournalName), qPrintable(journal.errorString()));
+    }
+
+    QMutexLocker locker(&mMutex);
+    while (true)
+    {
+        if (mEdits.empty() && !mIsStopping && !mIsCompactRequested)
+        {
+            // Compact once edits have been quiet for a while
+            if (journalEdits == 0)
+            {
+                mCondition.wait(&mMutex);
+            }
+            else if (!mCondition.wait(&mMutex, CompactDelay))
+            {
+                locker.unlock();
+                if (compact(journal))
+                {
+                    journalEdits = 0;
+                }
+                locker.relock();
+            }
+            continue;
+        }
+        std::vector<Edit> edits;
+        edits.swap(mEdits);
+        bool isStopping = mIsStopping;
+        bool isCompactRequested = mIsCompactRequested;
+        mIsCompactRequested = false;
+        locker.unlock();
+
+        if (!edits.empty())
+        {
+            append(journal, edits);
+            journalEdits += int(edits.size());
+        }
+        if (journalEdits > 0 && (isStopping || isCompactRequested || journal.size() > CompactSize))
+        {
+            // Kept on refusal, so the next trigger tries again
+            if (compact(journal))
+            {
+                journalEdits = 0;
+            }
+        }
+        else if (isCompactRequested)
+        {
+            // Nothing to write, only the journal has to follow the new file
+            restart(journal, checksumOf(mFileName));
+        }
+
+        locker.relock();
+        if (isStopping && mEdits.empty())
+        {
+            break;
+        }
+    }
+}
+
+
+void RuleJournal::push(const Edit &edit)
+{
+    QMutexLocker locker(&mMutex);
+    mEdits.push_back(edit);
+    mCondition.wakeOne();
+}
+
+
+int RuleJournal::replay(quint32 fileChecksum)
+{
+    QFile journal(mJournalName);
+    if (!journal.open(QIODevice::ReadOnly))
+    {
+        return -1;
+    }
+    QByteArray data = journal.readAll();
+    QDataStream stream(data);
+    char magic[sizeof(Magic)];
+    quint32 version(0);
+    quint32 checksum(0);
+    if (stream.readRawData(magic, sizeof(magic)) != int(sizeof(magic)) || memcmp(magic, Magic, sizeof(Magic)) != 0)
+    {
+        qWarning("RuleJournal: %s is not a rule journal", qPrintable(mJournalName));
+        return -1;
+    }
+    stream >> version >> checksum;
+    if (stream.status() != QDataStream::Ok || version != Version || checksum != fileChecksum)
+    {
+        // Written before the last compaction or for another file
+        return -1;
+    }
+
+    // A crash can leave the last entry torn, everything before it is intact
+    int count = 0;
+    while (!stream.atEnd())
+    {
+        quint32 entryChecksum(0);
+        QByteArray payload;
+        stream >> entryChecksum >> payload;
+        Edit edit = { Edit::RemoveRule, 0, MouseRuleData(), MouseRuleSettings() };
+        if (stream.status() != QDataStream::Ok
+            || BinaryRuleFile::checksum(reinterpret_cast<const uchar*>(payload.constData()), payload.size()) != entryChecksum
+            || !decode(payload, edit))
+        {
+            qWarning("RuleJournal: %s: dropped a torn entry after %d edits", qPrintable(mJournalName), count);
+            break;
+        }
+        apply(edit, mSettings, mRules);
+        ++count;
+    }
+    return count;
+}
+
+
+bool RuleJournal::append(QFile &journal, const std::vector<Edit> &edits)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    for (auto e = edits.begin(); e != edits.end(); ++e)
+    {
+        QByteArray payload = encode(*e);
+        stream << BinaryRuleFile::checksum(reinterpret_cast<const uchar*>(payload.constData()), payload.size()) << payload;
+        apply(*e, mSettings, mRules);
+    }
+    if (!journal.isOpen() || journal.write(data) != data.size() || !journal.flush() || fdatasync(journal.handle()) != 0)
+    {
+        qWarning("RuleJournal: cannot append to %s: %s", qPrintable(mJournalName), qPrintable(journal.errorString()));
+        return false;
+    }
+    return true;
+}
+
+
+bool RuleJournal::compact(QFile &journal)
+{
+    // Someone else replaced the file, the watcher reloads it and requests a compaction onto it
+    if (checksumOf(mFileName) != fileChecksum())
+    {
+        qDebug("RuleJournal: %s changed on disk, compacting once it is reloaded", qPrintable(mFileName));
+        return false;
+    }
+    // Keep journaling into the old journal if the file cannot be written
+    if (!MouseRuleConfig::write(mFileName, mSettings, mRules))
+    {
+        return false;
+    }
+    return restart(journal, checksumOf(mFileName));
+}
+
+
+bool RuleJournal::restart(QFile &journal, quint32 fileChecksum)
+{
+    journal.close();
+    QSaveFile file(mJournalName);
+    QByteArray header;
+    QDataStream stream(&header, QIODevice::WriteOnly);
+    stream.writeRawData(Magic, sizeof(Magic));
+    stream << quint32(Version) << fileChecksum;
+    bool isWritten = file.open(QIODevice::WriteOnly) && file.write(header) == header.size() && file.commit();
+    if (isWritten)
+    {
+        QMutexLocker locker(&mMutex);
+        mFileChecksum = fileChecksum;
+    }
+    if (!isWritten || !journal.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        qWarning("RuleJournal: cannot write %s: %s", qPrintable(mJournalName),
+                 qPrintable(isWritten ? journal.errorString() : file.errorString()));
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,95 @@
+#ifndef RULEJOURNAL_HPP
+#define RULEJOURNAL_HPP
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <vector>
+#include "MouseRuleConfig.hpp"
+class QFile;
+
+
+// Autosaves a rule config without blocking the GUI. Every edit is queued
+// and appended to <file>.journal on a background thread, which also keeps
+// its own copy of the rules. Once edits have been quiet for a while, the
+// journal grows too large or the journal is destroyed, that copy is
+// written to <file> (temporary file and rename) and the journal restarts.
+// The journal starts with the checksum of the file it extends, so a
+// journal left over from before a compaction is ignored on restore. A file
+// that changed on disk since is never overwritten by a compaction.
+class RuleJournal : public QThread, public MouseRuleObserver
+{
+    Q_OBJECT
+
+public:
+    enum
+    {
+        Version = 3,
+        CompactDelay = 10000, // ms
+        CompactSize = 256 * 1024
+    };
+
+    explicit RuleJournal(const QString &fileName, QObject *parent = 0);
+    ~RuleJournal();
+
+    // mouse_rules.ini in the user's config directory
+    static QString defaultFileName();
+    const QString &fileName() const;
+    // CRC-32 of the file as last written or restored by the journal
+    quint32 fileChecksum() const;
+    // Compacts right away onto a file someone else replaced, once its
+    // content (with this checksum) has been applied to the config
+    void requestCompaction(quint32 fileChecksum);
+
+    // Loads the file, replays the journal on top, puts the result into
+    // config and journals config's edits from then on
+    void restore(MouseRuleConfig &config);
+
+    void ruleAdded(int index, const MouseRuleData &rule);
+    void ruleChanged(int index, const MouseRuleData &rule);
+    void ruleRemoved(int index);
+    void settingsChanged(const MouseRuleSettings &settings);
+
+    struct Edit
+    {
+        enum Type
+        {
+            AddRule,
+            ChangeRule,
+            RemoveRule,
+            ChangeSettings
+        };
+
+        Type type;
+        int index;
+        MouseRuleData rule;
+        MouseRuleSettings settings;
+    };
+
+protected:
+    void run();
+
+private:
+    void push(const Edit &edit);
+    int replay(quint32 fileChecksum);
+    bool append(QFile &journal, const std::vector<Edit> &edits);
+    bool compact(QFile &journal);
+    bool restart(QFile &journal, quint32 fileChecksum);
+
+private:
+    QString mFileName;
+    QString mJournalName;
+    mutable QMutex mMutex;
+    QWaitCondition mCondition;
+    std::vector<Edit> mEdits;
+    bool mIsStopping;
+    bool mIsCompactRequested;
+    quint32 mFileChecksum;
+    // Owned by the journal thread once started
+    MouseRuleSettings mSettings;
+    MouseRules mRules;
+    bool mIsCompactDue;
+    bool mIsJournalStale;
+};
+
+#endif // RULEJOURNAL_HPP
@@ -0,0 +1,599 @@
+#include "RuleScheduler.hpp"
+#include "MouseRobot.hpp"
+#include "PixelSampler.hpp"
+#include <QFile>
+#include <QTextStream>
+#include <QtGlobal>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <sys/timerfd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctime>
+#include <algorithm>
+#include <functional>
+
+
+namespace
+{
+const qint64 NanoSecondsPerSecond = 1000000000ll;
+// Scheduler floor of 1 us, not 1 ms: microsecond interval rules go below a
+// millisecond, the GUI's millisecond mode has its own 1 ms minimum
+const qint64 MinimumInterval = 1000ll;
+// Burst catch-up fires at most this many missed deadlines, older ones are skipped
+const qint64 MaxBurst = 100;
+// Microsecond rules wake up this early and busy-wait the rest. About the
+// wake-up latency of a timer with 1 ns slack, so a 100 us rule still sleeps
+// half of each interval instead of spinning through all of it.
+const qint64 SpinLead = 50000ll;
+
+
+inline void cpuRelax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+}
+
+
+// Keeps a spinning thread on one core, so it is not migrated mid-wait
+void pinCurrentThread()
+{
+    // Timers of this thread expire as exactly as the kernel allows
+    prctl(PR_SET_TIMERSLACK, 1ul, 0ul, 0ul, 0ul);
+
+    // Highest CPU the thread may run on, so taskset, cgroups and --cpus are
+    // kept and offline or missing CPU numbers are never picked
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+    {
+        qWarning("RuleScheduler: cannot read CPU affinity, not pinned");
+        return;
+    }
+    int cpu = CPU_SETSIZE - 1;
+    while (cpu > 0 && !CPU_ISSET(cpu, &set))
+    {
+        --cpu;
+    }
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    {
+        qWarning("RuleScheduler: cannot pin to CPU %d", cpu);
+    }
+    else
+    {
+        qDebug("RuleScheduler: pinned to CPU %d for microsecond rules", cpu);
+    }
+}
+}
+
+
+RuleScheduler::RuleScheduler(MouseRobot *robot, QObject *parent)
+    : QThread(parent)
+    , mRobot(robot)
+    , mFireObserver(0)
+    , mMutex()
+    , mEntries()
+    , mHeap()
+    , mCatchUpPolicy(BurstCatchUp)
+    , mThreadSettings()
+    , mIsThreadSettingsChanged(false)
+    , mIsActive(false)
+    , mIsSuspended(false)
+    , mIsUpdating(false)
+    , mIsHeapDirty(false)
+    , mIsConditionsChanged(false)
+    , mSampler()
+    , mTimerFd(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC))
+    , mWakeFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+}
+
+
+RuleScheduler::~RuleScheduler()
+{
+    setActive(false);
+    if (mTimerFd >= 0)
+    {
+        close(mTimerFd);
+        mTimerFd = -1;
+    }
+    if (mWakeFd >= 0)
+    {
+        close(mWakeFd);
+        mWakeFd = -1;
+    }
+}
+
+
+qint64 RuleScheduler::now()
+{
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return static_cast<qint64>(time.tv_sec) * NanoSecondsPerSecond + time.tv_nsec;
+}
+
+
+void RuleScheduler::setActive(bool isActive)
+{
+    if (isActive)
+    {
+        QMutexLocker locker(&mMutex);
+        if (!mIsActive)
+        {
+            // Every rule starts a fresh timeline
+            mIsActive = true;
+            qint64 t = now();
+            for (auto e = mEntries.begin(); e != mEntries.end(); ++e)
+            {
+                e->deadline = t + e->rule.interval;
+            }
+            rebuildHeap();
+            locker.unlock();
+            start();
+        }
+    }
+    else
+    {
+        QMutexLocker locker(&mMutex);
+        mIsActive = false;
+        locker.unlock();
+        wake();
+        wait();
+    }
+}
+
+
+bool RuleScheduler::isActive() const
+{
+    QMutexLocker locker(&mMutex);
+    return mIsActive;
+}
+
+
+void RuleScheduler::setSuspended(bool isSuspended)
+{
+    QMutexLocker locker(&mMutex);
+    mIsSuspended = isSuspended;
+}
+
+
+void RuleScheduler::setFireObserver(RuleFireObserver *observer)
+{
+    QMutexLocker locker(&mMutex);
+    mFireObserver = observer;
+}
+
+
+void RuleScheduler::setThreadSettings(const ThreadSettings &settings)
+{
+    QMutexLocker locker(&mMutex);
+    if (mThreadSettings != settings)
+    {
+        mThreadSettings = settings;
+        mIsThreadSettingsChanged = true;
+        locker.unlock();
+        wake();
+    }
+}
+
+
+void RuleScheduler::ruleAdded(int index, const MouseRuleData &rule)
+{
+    MouseRuleAction action(rule);
+    QMutexLocker locker(&mMutex);
+    Entry entry;
+    entry.rule = rule;
+    entry.action = action;
+    entry.rule.interval = std::max(rule.interval, MinimumInterval);
+    entry.deadline = now() + entry.rule.interval;
+    entry.condition = -1;
+    entry.histogram = std::make_shared<FireHistogram>();
+    index = std::max(0, std::min(index, static_cast<int>(mEntries.size())));
+    mEntries.insert(mEntries.begin() + index, entry);
+    mIsConditionsChanged = mIsConditionsChanged || rule.condition.isEnabled;
+    if (mIsUpdating)
+    {
+        // Rebuilt once by rulesUpdated()
+        mIsHeapDirty = true;
+        return;
+    }
+    if (index + 1 == static_cast<int>(mEntries.size()))
+    {
+        // Appending keeps all other indices, so loading large configs stays linear
+        Deadline deadline;
+        deadline.time = entry.deadline;
+        deadline.index = index;
+        mHeap.push_back(deadline);
+        std::push_heap(mHeap.begin(), mHeap.end(), std::greater<Deadline>());
+    }
+    else
+    {
+        rebuildHeap();
+    }
+    locker.unlock();
+    wake();
+}
+
+
+void RuleScheduler::ruleChanged(int index, const MouseRuleData &rule)
+{
+    MouseRuleAction action(rule);
+    QMutexLocker locker(&mMutex);
+    if (index >= 0 && index < static_cast<int>(mEntries.size()))
+    {
+        Entry &entry = mEntries[index];
+        qint64 interval = std::max(rule.interval, MinimumInterval);
+        bool isIntervalChanged = entry.rule.interval != interval;
+        if (isIntervalChanged)
+        {
+            // Keep the phase of the last planned fire. A shorter interval can
+            // put that in the past, which is no miss: continue at the next
+            // deadline of the new timeline instead of catching up.
+            entry.deadline += interval - entry.rule.interval;
+            qint64 t = now();
+            if (entry.deadline <= t)
+            {
+                entry.deadline += ((t - entry.deadline) / interval + 1) * interval;
+            }
+        }
+        if (entry.rule.condition != rule.condition)
+        {
+            entry.condition = -1;
+            mIsConditionsChanged = true;
+        }
+        entry.rule = rule;
+        entry.action = action;
+        entry.rule.interval = interval;
+        if (isIntervalChanged && mIsUpdating)
+        {
+            mIsHeapDirty = true;
+        }
+        else if (isIntervalChanged)
+        {
+            rebuildHeap();
+            locker.unlock();
+            wake();
+        }
+    }
+}
+
+
+void RuleScheduler::settingsChanged(const MouseRuleSettings &settings)
+{
+    if (mRobot)
+    {
+        mRobot->setMotion(settings.motion);
+    }
+    QMutexLocker locker(&mMutex);
+    mCatchUpPolicy = settings.catchUpPolicy;
+}
+
+
+void RuleScheduler::rulesUpdating()
+{
+    QMutexLocker locker(&mMutex);
+    mIsUpdating = true;
+}
+
+
+void RuleScheduler::rulesUpdated()
+{
+    QMutexLocker locker(&mMutex);
+    mIsUpdating = false;
+    if (mIsHeapDirty)
+    {
+        rebuildHeap();
+    }
+    locker.unlock();
+    wake();
+}
+
+
+void RuleScheduler::ruleRemoved(int index)
+{
+    QMutexLocker locker(&mMutex);
+    if (index >= 0 && index < static_cast<int>(mEntries.size()))
+    {
+        mIsConditionsChanged = mIsConditionsChanged || mEntries[index].rule.condition.isEnabled;
+        mEntries.erase(mEntries.begin() + index);
+        if (mIsUpdating)
+        {
+            // Clearing a large config stays linear
+            mIsHeapDirty = true;
+            return;
+        }
+        rebuildHeap();
+        locker.unlock();
+        wake();
+    }
+}
+
+
+qreal RuleScheduler::progress(int index) const
+{
+    QMutexLocker locker(&mMutex);
+    if (mIsActive && index >= 0 && index < static_cast<int>(mEntries.size()))
+    {
+        const Entry &entry = mEntries[index];
+        qreal p = 1.0 - static_cast<qreal>(entry.deadline - now()) / entry.rule.interval;
+        return std::max(0.0, std::min(p, 1.0));
+    }
+    return 0.0;
+}
+
+
+std::shared_ptr<const FireHistogram> RuleScheduler::histogram(int index) const
+{
+    QMutexLocker locker(&mMutex);
+    if (index >= 0 && index < static_cast<int>(mEntries.size()))
+    {
+        return mEntries[index].histogram;
+    }
+    return std::shared_ptr<const FireHistogram>();
+}
+
+
+bool RuleScheduler::writeHistograms(const QString &fileName) const
+{
+    std::vector<std::shared_ptr<const FireHistogram> > histograms;
+    {
+        QMutexLocker locker(&mMutex);
+        for (auto e = mEntries.begin(); e != mEntries.end(); ++e)
+        {
+            histograms.push_back(e->histogram);
+        }
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        return false;
+    }
+    QTextStream stream(&file);
+    for (size_t i = 0; i < histograms.size(); ++i)
+    {
+        stream << "rule " << i + 1 << " ";
+        histograms[i]->write(stream);
+    }
+    return true;
+}
+
+
+void RuleScheduler::run()
+{
+    bool isPinned = false;
+    QMutexLocker locker(&mMutex);
+    // A fresh thread starts with default scheduling
+    mIsThreadSettingsChanged = mIsThreadSettingsChanged || mThreadSettings != ThreadSettings();
+    while (mIsActive)
+    {
+        if (mIsThreadSettingsChanged)
+        {
+            ThreadSettings settings = mThreadSettings;
+            mIsThreadSettingsChanged = false;
+            locker.unlock();
+            settings.apply("RuleScheduler");
+            if (mRobot)
+            {
+                mRobot->setThreadSettings(settings);
+            }
+            locker.relock();
+            isPinned = false;
+        }
+
+        // Arm timer for earliest deadline (disarmed if there is none or rules are being updated)
+        itimerspec spec;
+        memset(&spec, 0x00, sizeof(spec));
+        qint64 spinUntil = 0;
+        if (!mHeap.empty() && !mIsUpdating)
+        {
+            qint64 wakeTime = mHeap.front().time;
+            if (mEntries[mHeap.front().index].rule.intervalMode == MicrosecondsInterval)
+            {
+                if (!isPinned)
+                {
+                    pinCurrentThread();
+                    isPinned = true;
+                }
+                spinUntil = wakeTime;
+                wakeTime = std::max<qint64>(wakeTime - SpinLead, 1);
+            }
+            spec.it_value.tv_sec = wakeTime / NanoSecondsPerSecond;
+            spec.it_value.tv_nsec = wakeTime % NanoSecondsPerSecond;
+        }
+        timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, &spec, 0);
+
+        // Sleep until deadline or until rules change
+        locker.unlock();
+        pollfd fds[2];
+        fds[0].fd = mTimerFd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        fds[1].fd = mWakeFd;
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+        poll(fds, 2, -1);
+        quint64 count;
+        if (fds[0].revents & POLLIN)
+        {
+            (void)read(mTimerFd, &count, sizeof(count));
+            while (now() < spinUntil)
+            {
+                cpuRelax();
+            }
+        }
+        if (fds[1].revents & POLLIN)
+        {
+            (void)read(mWakeFd, &count, sizeof(count));
+        }
+        locker.relock();
+        if (mIsConditionsChanged)
+        {
+            updateConditions(locker);
+        }
+
+        // One capture serves every conditional rule due now, taken without
+        // the lock since it waits for the X server
+        qint64 t = now();
+        bool isSampled = false;
+        if (mSampler && !mIsUpdating && isConditionDue(0, t))
+        {
+            locker.unlock();
+            isSampled = mSampler->sample();
+            locker.relock();
+        }
+
+        // Fire everything that is due, the robot sends it in one batch
+        bool isFired = false;
+        while (mIsActive && !mIsUpdating && !mHeap.empty() && mHeap.front().time <= t)
+        {
+            std::pop_heap(mHeap.begin(), mHeap.end(), std::greater<Deadline>());
+            Deadline &due = mHeap.back();
+            Entry &entry = mEntries[due.index];
+            qint64 deadline = due.time;
+            int index = due.index;
+            bool isDue = true;
+            entry.deadline = catchUp(entry, deadline, t, isDue);
+            due.time = entry.deadline;
+            std::push_heap(mHeap.begin(), mHeap.end(), std::greater<Deadline>());
+            if (isDue && entry.rule.condition.isEnabled)
+            {
+                isDue = isSampled && mSampler->matches(entry.condition);
+            }
+            if (isDue && mRobot)
+            {
+                isFired = true;
+                if (!entry.action.invoke(*mRobot))
+                {
+                    // The robot's queue was full, the click never happens
+                    entry.histogram->skip(1);
+                }
+                else
+                {
+                    entry.histogram->record(t - deadline);
+                    if (mFireObserver)
+                    {
+                        mFireObserver->ruleFired(index, deadline, t);
+                    }
+                }
+            }
+        }
+        if (isFired)
+        {
+            mRobot->submit();
+        }
+    }
+}
+
+
+qint64 RuleScheduler::catchUp(Entry &entry, qint64 deadline, qint64 time, bool &isDue) const
+{
+    // Deadlines after this one that have passed as well
+    qint64 interval = entry.rule.interval;
+    qint64 behind = (time - deadline) / interval;
+    if (behind == 0)
+    {
+        isDue = !mIsSuspended;
+        return deadline + interval;
+    }
+
+    if (mIsSuspended)
+    {
+        // Nothing fires while suspended, so nothing is missed either
+        isDue = false;
+        return deadline + (behind + 1) * interval;
+    }
+
+    switch (mCatchUpPolicy)
+    {
+    case SkipCatchUp:
+        // Drop everything that is overdue and wait for the next deadline
+        isDue = false;
+        entry.histogram->skip(behind + 1);
+        return deadline + (behind + 1) * interval;
+    case BurstCatchUp:
+        // Fire this one, the next is due right away
+        isDue = true;
+        if (behind > MaxBurst)
+        {
+            entry.histogram->skip(behind - MaxBurst);
+            return deadline + (behind - MaxBurst + 1) * interval;
+        }
+        return deadline + interval;
+    case CoalesceCatchUp:
+        // Fire once for all overdue deadlines
+        isDue = true;
+        entry.histogram->skip(behind);
+        return deadline + (behind + 1) * interval;
+    }
+    return deadline + interval;
+}
+
+
+bool RuleScheduler::isConditionDue(size_t node, qint64 time) const
+{
+    // Only visits the part of the heap that is due
+    if (node >= mHeap.size() || mHeap[node].time > time)
+    {
+        return false;
+    }
+    return mEntries[mHeap[node].index].rule.condition.isEnabled
+        || isConditionDue(2 * node + 1, time)
+        || isConditionDue(2 * node + 2, time);
+}
+
+
+void RuleScheduler::rebuildHeap()
+{
+    mIsHeapDirty = false;
+    mHeap.clear();
+    mHeap.reserve(mEntries.size());
+    for (size_t i = 0; i < mEntries.size(); ++i)
+    {
+        Deadline deadline;
+        deadline.time = mEntries[i].deadline;
+        deadline.index = static_cast<int>(i);
+        mHeap.push_back(deadline);
+    }
+    std::make_heap(mHeap.begin(), mHeap.end(), std::greater<Deadline>());
+}
+
+
+void RuleScheduler::updateConditions(QMutexLocker &locker)
+{
+    mIsConditionsChanged = false;
+    std::vector<PixelCondition> conditions;
+    for (auto e = mEntries.begin(); e != mEntries.end(); ++e)
+    {
+        e->condition = e->rule.condition.isEnabled ? static_cast<int>(conditions.size()) : -1;
+        if (e->rule.condition.isEnabled)
+        {
+            conditions.push_back(e->rule.condition);
+        }
+    }
+
+    // Edits meanwhile flag another update, their rules do not fire until then
+    locker.unlock();
+    if (!mSampler && !conditions.empty())
+    {
+        mSampler.reset(new PixelSampler());
+    }
+    if (mSampler)
+    {
+        mSampler->setConditions(conditions);
+    }
+    locker.relock();
+}
+
+
+void RuleScheduler::wake()
+{
+    quint64 one = 1;
+    (void)write(mWakeFd, &one, sizeof(one));
+}
@@ -0,0 +1,111 @@
+#ifndef RULESCHEDULER_HPP
+#define RULESCHEDULER_HPP
+
+#include <QThread>
+#include <QMutex>
+#include <memory>
+#include <vector>
+#include "FireHistogram.hpp"
+#include "MouseRuleConfig.hpp"
+#include "ThreadSettings.hpp"
+class MouseRobot;
+class PixelSampler;
+
+
+class RuleFireObserver
+{
+public:
+    virtual ~RuleFireObserver() { }
+    // Called on the scheduler thread for every invoked rule, must not block
+    virtual void ruleFired(int index, qint64 deadline, qint64 time) = 0;
+};
+
+
+// Fires rules from a min-heap of deadlines, sleeping on an absolute
+// CLOCK_MONOTONIC timer in between. Rules are invoked on this thread from
+// its own copy of the rule data. Each rule keeps an absolute timeline
+// (next deadline = previous deadline + interval), so lateness never adds
+// up; deadlines missed while behind are handled by the catch-up policy.
+// Rules with a pixel condition only fire if the screen matches right
+// before they are invoked. All times are in nanoseconds.
+class RuleScheduler : public QThread, public MouseRuleObserver
+{
+    Q_OBJECT
+
+public:
+    explicit RuleScheduler(MouseRobot *robot, QObject *parent = 0);
+    ~RuleScheduler();
+
+    static qint64 now();
+
+public:
+    void setActive(bool isActive);
+    bool isActive() const;
+    void setSuspended(bool isSuspended);
+    void setFireObserver(RuleFireObserver *observer);
+    // Also applied to the robot's injection thread
+    void setThreadSettings(const ThreadSettings &settings);
+    qreal progress(int index) const;
+    // Lateness of every fire of a rule, kept while the rule is edited
+    std::shared_ptr<const FireHistogram> histogram(int index) const;
+    bool writeHistograms(const QString &fileName) const;
+
+    void ruleAdded(int index, const MouseRuleData &rule);
+    void ruleChanged(int index, const MouseRuleData &rule);
+    void ruleRemoved(int index);
+    void settingsChanged(const MouseRuleSettings &settings);
+    // Nothing fires in between, so a reload takes effect at once. Rules
+    // added or removed in between rebuild the heap only once at the end.
+    void rulesUpdating();
+    void rulesUpdated();
+
+protected:
+    void run();
+
+private:
+    struct Entry
+    {
+        MouseRuleData rule;
+        MouseRuleAction action;
+        qint64 deadline;
+        // Index into the sampler's conditions, -1 until it is sampled
+        int condition;
+        std::shared_ptr<FireHistogram> histogram;
+    };
+
+    struct Deadline
+    {
+        qint64 time;
+        int index;
+        bool operator>(const Deadline &other) const { return time > other.time; }
+    };
+
+    qint64 catchUp(Entry &entry, qint64 deadline, qint64 time, bool &isDue) const;
+    // Whether a rule with a pixel condition is due in the subheap at node
+    bool isConditionDue(size_t node, qint64 time) const;
+    void rebuildHeap();
+    void updateConditions(QMutexLocker &locker);
+    void wake();
+
+private:
+    MouseRobot *mRobot;
+    RuleFireObserver *mFireObserver;
+    mutable QMutex mMutex;
+    std::vector<Entry> mEntries;
+    std::vector<Deadline> mHeap;
+    ECatchUpPolicy mCatchUpPolicy;
+    ThreadSettings mThreadSettings;
+    bool mIsThreadSettingsChanged;
+    bool mIsActive;
+    bool mIsSuspended;
+    bool mIsUpdating;
+    // Rule indices changed while updating, the heap is rebuilt afterwards
+    bool mIsHeapDirty;
+    bool mIsConditionsChanged;
+    // Created on the scheduler thread once a rule has a condition
+    std::unique_ptr<PixelSampler> mSampler;
+    int mTimerFd;
+    int mWakeFd;
+};
+
+#endif // RULESCHEDULER_HPP
@@ -0,0 +1,171 @@
+#include "ThreadSettings.hpp"
+#include <QCommandLineParser>
+#include <QStringList>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+
+
+ThreadSettings::ThreadSettings()
+    : realtimePriority(0)
+    , isMemoryLocked(false)
+    , cpuMask(0)
+{
+}
+
+
+bool ThreadSettings::operator==(const ThreadSettings &other) const
+{
+    return realtimePriority == other.realtimePriority
+        && isMemoryLocked == other.isMemoryLocked
+        && cpuMask == other.cpuMask;
+}
+
+
+bool ThreadSettings::operator!=(const ThreadSettings &other) const
+{
+    return !(*this == other);
+}
+
+
+void ThreadSettings::apply(const char *threadName) const
+{
+    // CPU affinity, an empty mask restores all CPUs
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if (cpuMask == 0 || (cpu < 64 && (cpuMask & (1ull << cpu)) != 0))
+        {
+            CPU_SET(cpu, &set);
+        }
+    }
+    QString cpus = formatCpus(cpuMask);
+    int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (error != 0)
+    {
+        qWarning("%s: cannot set CPU affinity %s: %s", threadName, qPrintable(cpus), strerror(error));
+        cpus = "all";
+    }
+
+    // SCHED_FIFO, limited to what RLIMIT_RTPRIO grants unprivileged users
+    int priority = std::max(0, std::min(realtimePriority, sched_get_priority_max(SCHED_FIFO)));
+    sched_param param;
+    memset(&param, 0x00, sizeof(param));
+    error = EPERM;
+    if (priority > 0)
+    {
+        param.sched_priority = priority;
+        error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        rlimit limit;
+        if (error == EPERM && getrlimit(RLIMIT_RTPRIO, &limit) == 0
+            && limit.rlim_cur > 0 && limit.rlim_cur < static_cast<rlim_t>(priority))
+        {
+            priority = static_cast<int>(limit.rlim_cur);
+            param.sched_priority = priority;
+            error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        }
+        if (error != 0)
+        {
+            qWarning("%s: SCHED_FIFO %d not permitted (%s), using normal scheduling",
+                     threadName, realtimePriority, strerror(error));
+        }
+    }
+    if (error != 0)
+    {
+        param.sched_priority = 0;
+        pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+    }
+
+    // Process wide, repeated calls are harmless
+    bool isLocked = false;
+    if (isMemoryLocked)
+    {
+        isLocked = mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+        if (!isLocked)
+        {
+            qWarning("%s: mlockall failed: %s", threadName, strerror(errno));
+        }
+    }
+
+    qDebug("%s: %s, CPUs %s, memory %s", threadName,
+           error == 0 ? qPrintable(QString("SCHED_FIFO %1").arg(priority)) : "SCHED_OTHER",
+           qPrintable(cpus), isLocked ? "locked" : "not locked");
+}
+
+
+quint64 ThreadSettings::parseCpus(const QString &cpus)
+{
+    quint64 mask = 0;
+    QStringList parts = cpus.split(',', QString::SkipEmptyParts);
+    for (auto p = parts.begin(); p != parts.end(); ++p)
+    {
+        QStringList range = p->trimmed().split('-');
+        bool isFirstValid = false;
+        bool isLastValid = false;
+        int first = range.front().toInt(&isFirstValid);
+        int last = range.size() == 2 ? range.back().toInt(&isLastValid) : first;
+        if (!isFirstValid || (range.size() == 2 && !isLastValid) || range.size() > 2)
+        {
+            continue;
+        }
+        for (int cpu = std::max(first, 0); cpu <= last && cpu < 64; ++cpu)
+        {
+            mask |= 1ull << cpu;
+        }
+    }
+    return mask;
+}
+
+
+QString ThreadSettings::formatCpus(quint64 cpuMask)
+{
+    if (cpuMask == 0)
+    {
+        return QString("all");
+    }
+    QStringList ranges;
+    for (int cpu = 0; cpu < 64; ++cpu)
+    {
+        if ((cpuMask & (1ull << cpu)) == 0)
+        {
+            continue;
+        }
+        int last = cpu;
+        while (last + 1 < 64 && (cpuMask & (1ull << (last + 1))) != 0)
+        {
+            ++last;
+        }
+        ranges << (last > cpu ? QString("%1-%2").arg(cpu).arg(last) : QString::number(cpu));
+        cpu = last;
+    }
+    return ranges.join(",");
+}
+
+
+void ThreadSettings::addOptions(QCommandLineParser &parser)
+{
+    parser.addOption(QCommandLineOption("realtime", "Run scheduler and injection with SCHED_FIFO <priority> (1-99).", "priority"));
+    parser.addOption(QCommandLineOption("lock-memory", "Lock all memory with mlockall."));
+    parser.addOption(QCommandLineOption("cpus", "Restrict scheduler and injection to <list>, e.g. 2-3.", "list"));
+}
+
+
+ThreadSettings ThreadSettings::fromOptions(const QCommandLineParser &parser)
+{
+    ThreadSettings settings;
+    if (parser.isSet("realtime"))
+    {
+        settings.realtimePriority = parser.value("realtime").toInt();
+    }
+    settings.isMemoryLocked = parser.isSet("lock-memory");
+    if (parser.isSet("cpus"))
+    {
+        settings.cpuMask = parseCpus(parser.value("cpus"));
+    }
+    return settings;
+}
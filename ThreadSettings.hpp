@@ -0,0 +1,38 @@
+#ifndef THREADSETTINGS_HPP
+#define THREADSETTINGS_HPP
+
+#include <QtGlobal>
+#include <QString>
+class QCommandLineParser;
+
+
+// Scheduling of the rule scheduler and injection threads. Everything is
+// opt-in and falls back to normal scheduling when not permitted. Only the
+// user sets these on the command line, rule files cannot raise privileges.
+struct ThreadSettings
+{
+    ThreadSettings();
+
+    bool operator==(const ThreadSettings &other) const;
+    bool operator!=(const ThreadSettings &other) const;
+
+    // Applies to the calling thread and logs the mode actually obtained
+    void apply(const char *threadName) const;
+
+    // CPU lists like "0-3,6", empty for all CPUs
+    static quint64 parseCpus(const QString &cpus);
+    static QString formatCpus(quint64 cpuMask);
+
+    // --realtime, --lock-memory and --cpus
+    static void addOptions(QCommandLineParser &parser);
+    static ThreadSettings fromOptions(const QCommandLineParser &parser);
+
+    // SCHED_FIFO priority (1-99), 0 keeps normal scheduling
+    int realtimePriority;
+    // mlockall() for the whole process, so faults never stall a click
+    bool isMemoryLocked;
+    // One bit per CPU, 0 allows all
+    quint64 cpuMask;
+};
+
+#endif // THREADSETTINGS_HPP
@@ -0,0 +1,351 @@
+#include "XcbBackend.hpp"
+#include <xcb/xtest.h>
+#include <xcb/xinput.h>
+#include <QByteArray>
+#include <stdlib.h>
+#include <string.h>
+
+
+XcbBackend::XcbBackend()
+    : MouseRobotBackend()
+    , mConnection(NULL)
+    , mRoot(XCB_NONE)
+    , mParentWindow(XCB_NONE)
+    , mXiOpcode(-1)
+    , mXTestDeviceCount(0)
+    , mIsPointerDirty(true)
+    , mOwnWindow()
+    , mIsWindowDirty(true)
+{
+    memset(mXTestDevices, 0x00, sizeof(mXTestDevices));
+}
+
+
+XcbBackend::~XcbBackend()
+{
+    close();
+}
+
+
+const char *XcbBackend::name() const
+{
+    return "xcb";
+}
+
+
+bool XcbBackend::open(quintptr parentWindow)
+{
+    int screenNumber;
+    mConnection = xcb_connect(NULL, &screenNumber);
+    if (xcb_connection_has_error(mConnection))
+    {
+        xcb_disconnect(mConnection);
+        mConnection = NULL;
+        return false;
+    }
+
+    xcb_screen_iterator_t screens = xcb_setup_roots_iterator(xcb_get_setup(mConnection));
+    for (int i = 0; i < screenNumber && screens.rem > 0; ++i)
+    {
+        xcb_screen_next(&screens);
+    }
+    mRoot = screens.data->root;
+    mScreenSize = QSize(screens.data->width_in_pixels, screens.data->height_in_pixels);
+    mParentWindow = static_cast<xcb_window_t>(parentWindow);
+    refreshKeymap();
+    startTracking();
+    return true;
+}
+
+
+void XcbBackend::close()
+{
+    if (mConnection != NULL)
+    {
+        xcb_disconnect(mConnection);
+        mConnection = NULL;
+    }
+}
+
+
+void XcbBackend::processEvents()
+{
+    if (mConnection == NULL || xcb_connection_has_error(mConnection))
+    {
+        return;
+    }
+
+    bool isKeymapChanged = false;
+    xcb_generic_event_t *event;
+    while ((event = xcb_poll_for_event(mConnection)) != NULL)
+    {
+        switch (event->response_type & ~0x80)
+        {
+        case XCB_MAPPING_NOTIFY:
+            // Sent to every client unasked
+            if (reinterpret_cast<xcb_mapping_notify_event_t*>(event)->request != XCB_MAPPING_POINTER)
+            {
+                isKeymapChanged = true;
+            }
+            break;
+        case XCB_CONFIGURE_NOTIFY:
+        case XCB_MAP_NOTIFY:
+        case XCB_REPARENT_NOTIFY:
+            mIsWindowDirty = true;
+            break;
+        case XCB_FOCUS_IN:
+            if (reinterpret_cast<xcb_focus_in_event_t*>(event)->detail != XCB_NOTIFY_DETAIL_POINTER)
+            {
+                mIsOwnWindowFocused = true;
+            }
+            break;
+        case XCB_FOCUS_OUT:
+        {
+            quint8 detail = reinterpret_cast<xcb_focus_out_event_t*>(event)->detail;
+            if (detail != XCB_NOTIFY_DETAIL_POINTER && detail != XCB_NOTIFY_DETAIL_INFERIOR)
+            {
+                mIsOwnWindowFocused = false;
+            }
+            break;
+        }
+        case XCB_GE_GENERIC:
+            processGenericEvent(event);
+            break;
+        default:
+            break;
+        }
+        free(event);
+    }
+    if (isKeymapChanged)
+    {
+        refreshKeymap();
+    }
+}
+
+
+bool XcbBackend::prepare()
+{
+    if (mConnection == NULL || xcb_connection_has_error(mConnection))
+    {
+        return false;
+    }
+
+    processEvents();
+    // Without XInput2 nothing reports key presses, held modifiers are queried along with the pointer
+    xcb_query_keymap_cookie_t keymapCookie;
+    keymapCookie.sequence = 0;
+    if (mXiOpcode < 0)
+    {
+        keymapCookie = xcb_query_keymap(mConnection);
+    }
+    if (mIsPointerDirty)
+    {
+        xcb_query_pointer_reply_t *pointer = xcb_query_pointer_reply(mConnection, xcb_query_pointer(mConnection, mRoot), NULL);
+        if (pointer != NULL)
+        {
+            mPointer = QPoint(pointer->root_x, pointer->root_y);
+            free(pointer);
+        }
+
+        // Without XInput2 the pointer is queried for every batch
+        mIsPointerDirty = mXiOpcode < 0;
+    }
+    if (mXiOpcode < 0)
+    {
+        xcb_query_keymap_reply_t *keymap = xcb_query_keymap_reply(mConnection, keymapCookie, NULL);
+        if (keymap != NULL)
+        {
+            for (int code = 0; code < 256; ++code)
+            {
+                setKeyDown(code, (keymap->keys[code / 8] & (1 << (code % 8))) != 0);
+            }
+            free(keymap);
+        }
+    }
+    return true;
+}
+
+
+QRect XcbBackend::ownWindow()
+{
+    if (mIsWindowDirty && mParentWindow != XCB_NONE)
+    {
+        // Both requests go out before waiting for either reply
+        xcb_get_geometry_cookie_t geometryCookie = xcb_get_geometry(mConnection, mParentWindow);
+        xcb_translate_coordinates_cookie_t originCookie = xcb_translate_coordinates(mConnection, mParentWindow, mRoot, 0, 0);
+        xcb_get_geometry_reply_t *geometry = xcb_get_geometry_reply(mConnection, geometryCookie, NULL);
+        xcb_translate_coordinates_reply_t *origin = xcb_translate_coordinates_reply(mConnection, originCookie, NULL);
+        if (geometry != NULL && origin != NULL)
+        {
+            mOwnWindow = QRect(origin->dst_x, origin->dst_y, geometry->width, geometry->height);
+        }
+        free(geometry);
+        free(origin);
+        mIsWindowDirty = false;
+    }
+    return mOwnWindow;
+}
+
+
+void XcbBackend::fakeMotion(const QPoint &position, unsigned long delay)
+{
+    xcb_test_fake_input(mConnection, XCB_MOTION_NOTIFY, 0, delay, mRoot, position.x(), position.y(), 0);
+}
+
+
+void XcbBackend::fakeButton(quint32 button, bool isPress, unsigned long delay)
+{
+    xcb_test_fake_input(mConnection, isPress ? XCB_BUTTON_PRESS : XCB_BUTTON_RELEASE, button, delay, XCB_NONE, 0, 0, 0);
+}
+
+
+void XcbBackend::fakeKey(quint8 keyCode, bool isPress, unsigned long delay)
+{
+    xcb_test_fake_input(mConnection, isPress ? XCB_KEY_PRESS : XCB_KEY_RELEASE, keyCode, delay, XCB_NONE, 0, 0, 0);
+}
+
+
+void XcbBackend::flush()
+{
+    xcb_flush(mConnection);
+}
+
+
+bool XcbBackend::bindKey(quint8 keyCode, quint32 keySym)
+{
+    // Both levels, so the shift state does not matter
+    xcb_keysym_t syms[2] = { keySym, keySym };
+    xcb_change_keyboard_mapping(mConnection, 1, keyCode, 2, syms);
+    return true;
+}
+
+
+void XcbBackend::startTracking()
+{
+    // Send every setup request first, then collect the replies
+    xcb_input_xi_query_version_cookie_t versionCookie = xcb_input_xi_query_version(mConnection, 2, 0);
+    xcb_query_keymap_cookie_t keymapCookie = xcb_query_keymap(mConnection);
+    xcb_get_input_focus_cookie_t focusCookie = xcb_get_input_focus(mConnection);
+
+    const xcb_query_extension_reply_t *extension = xcb_get_extension_data(mConnection, &xcb_input_id);
+    xcb_input_xi_query_version_reply_t *version = xcb_input_xi_query_version_reply(mConnection, versionCookie, NULL);
+    if (extension != NULL && extension->present && version != NULL && version->major_version >= 2)
+    {
+        // Raw events are reported on the root window regardless of grabs and focus
+        mXiOpcode = extension->major_opcode;
+        struct
+        {
+            xcb_input_event_mask_t head;
+            quint32 mask;
+        } eventMask;
+        eventMask.head.deviceid = XCB_INPUT_DEVICE_ALL_MASTER;
+        eventMask.head.mask_len = 1;
+        eventMask.mask = XCB_INPUT_XI_EVENT_MASK_RAW_MOTION
+                       | XCB_INPUT_XI_EVENT_MASK_RAW_KEY_PRESS
+                       | XCB_INPUT_XI_EVENT_MASK_RAW_KEY_RELEASE;
+        xcb_input_xi_select_events(mConnection, mRoot, 1, &eventMask.head);
+
+        // Our own injected events come from the XTEST slave devices
+        xcb_input_xi_query_device_reply_t *devices = xcb_input_xi_query_device_reply(
+            mConnection, xcb_input_xi_query_device(mConnection, XCB_INPUT_DEVICE_ALL), NULL);
+        if (devices != NULL)
+        {
+            xcb_input_xi_device_info_iterator_t device = xcb_input_xi_query_device_infos_iterator(devices);
+            for (; device.rem > 0; xcb_input_xi_device_info_next(&device))
+            {
+                QByteArray name(xcb_input_xi_device_info_name(device.data), xcb_input_xi_device_info_name_length(device.data));
+                if (name.contains("XTEST") && mXTestDeviceCount < MaxXTestDevices)
+                {
+                    mXTestDevices[mXTestDeviceCount++] = device.data->deviceid;
+                }
+            }
+            free(devices);
+        }
+    }
+    free(version);
+
+    // Initial state, kept up to date from events from here on
+    xcb_query_keymap_reply_t *keymap = xcb_query_keymap_reply(mConnection, keymapCookie, NULL);
+    if (keymap != NULL)
+    {
+        for (int code = 0; code < 256; ++code)
+        {
+            setKeyDown(code, (keymap->keys[code / 8] & (1 << (code % 8))) != 0);
+        }
+        free(keymap);
+    }
+    xcb_get_input_focus_reply_t *focus = xcb_get_input_focus_reply(mConnection, focusCookie, NULL);
+    if (focus != NULL)
+    {
+        mIsOwnWindowFocused = mParentWindow != XCB_NONE && focus->focus == mParentWindow;
+        free(focus);
+    }
+    if (mParentWindow != XCB_NONE)
+    {
+        quint32 mask = XCB_EVENT_MASK_STRUCTURE_NOTIFY | XCB_EVENT_MASK_FOCUS_CHANGE;
+        xcb_change_window_attributes(mConnection, mParentWindow, XCB_CW_EVENT_MASK, &mask);
+    }
+    xcb_flush(mConnection);
+}
+
+
+void XcbBackend::refreshKeymap()
+{
+    const xcb_setup_t *setup = xcb_get_setup(mConnection);
+    int minCode = setup->min_keycode;
+    int maxCode = setup->max_keycode;
+    xcb_get_keyboard_mapping_reply_t *mapping = xcb_get_keyboard_mapping_reply(
+        mConnection, xcb_get_keyboard_mapping(mConnection, minCode, maxCode - minCode + 1), NULL);
+    if (mapping != NULL)
+    {
+        setKeyboardMapping(xcb_get_keyboard_mapping_keysyms(mapping), minCode, maxCode, mapping->keysyms_per_keycode);
+        free(mapping);
+    }
+}
+
+
+void XcbBackend::processGenericEvent(const xcb_generic_event_t *event)
+{
+    const xcb_ge_generic_event_t *generic = reinterpret_cast<const xcb_ge_generic_event_t*>(event);
+    if (generic->extension != mXiOpcode)
+    {
+        return;
+    }
+
+    // Our own injected events are already accounted for
+    switch (generic->event_type)
+    {
+    case XCB_INPUT_RAW_MOTION:
+        if (!isXTestDevice(reinterpret_cast<const xcb_input_raw_motion_event_t*>(event)->sourceid))
+        {
+            // Moved by the user, query where to in prepare
+            mIsPointerDirty = true;
+        }
+        break;
+    case XCB_INPUT_RAW_KEY_PRESS:
+    case XCB_INPUT_RAW_KEY_RELEASE:
+    {
+        const xcb_input_raw_key_press_event_t *key = reinterpret_cast<const xcb_input_raw_key_press_event_t*>(event);
+        if (!isXTestDevice(key->sourceid))
+        {
+            setKeyDown(key->detail, generic->event_type == XCB_INPUT_RAW_KEY_PRESS);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+
+bool XcbBackend::isXTestDevice(int deviceId) const
+{
+    for (int i = 0; i < mXTestDeviceCount; ++i)
+    {
+        if (mXTestDevices[i] == deviceId)
+        {
+            return true;
+        }
+    }
+    return false;
+}
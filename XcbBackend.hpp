@@ -0,0 +1,56 @@
+#ifndef XCBBACKEND_HPP
+#define XCBBACKEND_HPP
+
+#include "MouseRobotBackend.hpp"
+#include <xcb/xcb.h>
+
+
+// xcb + xcb-xtest backend. Requests are only written to the connection
+// buffer and go out on flush; the few queries that need a reply are sent
+// together and collected afterwards, never one round trip per request.
+class XcbBackend : public MouseRobotBackend
+{
+public:
+    XcbBackend();
+    ~XcbBackend();
+
+public:
+    const char *name() const;
+    bool open(quintptr parentWindow);
+    void close();
+    void processEvents();
+
+protected:
+    bool prepare();
+    QRect ownWindow();
+    void fakeMotion(const QPoint &position, unsigned long delay);
+    void fakeButton(quint32 button, bool isPress, unsigned long delay);
+    void fakeKey(quint8 keyCode, bool isPress, unsigned long delay);
+    void flush();
+    bool bindKey(quint8 keyCode, quint32 keySym);
+
+private:
+    void startTracking();
+    void refreshKeymap();
+    void processGenericEvent(const xcb_generic_event_t *event);
+    bool isXTestDevice(int deviceId) const;
+
+private:
+    // Usually one XTEST pointer and one XTEST keyboard
+    enum
+    {
+        MaxXTestDevices = 4
+    };
+
+    xcb_connection_t *mConnection;
+    xcb_window_t mRoot;
+    xcb_window_t mParentWindow;
+    int mXiOpcode;
+    int mXTestDevices[MaxXTestDevices];
+    int mXTestDeviceCount;
+    bool mIsPointerDirty;
+    QRect mOwnWindow;
+    bool mIsWindowDirty;
+};
+
+#endif // XCBBACKEND_HPP
@@ -0,0 +1,311 @@
+#include "XlibBackend.hpp"
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XTest.h>
+#include <X11/extensions/XInput2.h>
+#include <string.h>
+#include <vector>
+
+
+XlibBackend::XlibBackend()
+    : MouseRobotBackend()
+    , mDisplay(NULL)
+    , mParentWindow(0)
+    , mXiOpcode(-1)
+    , mXTestDeviceCount(0)
+    , mIsPointerDirty(true)
+    , mOwnWindow()
+    , mIsWindowDirty(true)
+{
+    memset(mXTestDevices, 0x00, sizeof(mXTestDevices));
+}
+
+
+XlibBackend::~XlibBackend()
+{
+    close();
+}
+
+
+const char *XlibBackend::name() const
+{
+    return "xlib";
+}
+
+
+bool XlibBackend::open(quintptr parentWindow)
+{
+    mParentWindow = parentWindow;
+    mDisplay = XOpenDisplay(NULL);
+    if (mDisplay == NULL)
+    {
+        return false;
+    }
+    int screen = DefaultScreen(mDisplay);
+    mScreenSize = QSize(DisplayWidth(mDisplay, screen), DisplayHeight(mDisplay, screen));
+    refreshKeymap();
+    startTracking();
+    return true;
+}
+
+
+void XlibBackend::close()
+{
+    if (mDisplay != NULL)
+    {
+        XCloseDisplay(mDisplay);
+        mDisplay = NULL;
+    }
+}
+
+
+void XlibBackend::processEvents()
+{
+    if (mDisplay == NULL)
+    {
+        return;
+    }
+
+    bool isKeymapChanged = false;
+    while (XPending(mDisplay) > 0)
+    {
+        XEvent event;
+        XNextEvent(mDisplay, &event);
+        switch (event.type)
+        {
+        case MappingNotify:
+            // Sent to every client unasked
+            if (event.xmapping.request != MappingPointer)
+            {
+                XRefreshKeyboardMapping(&event.xmapping);
+                isKeymapChanged = true;
+            }
+            break;
+        case ConfigureNotify:
+        case MapNotify:
+        case ReparentNotify:
+            mIsWindowDirty = true;
+            break;
+        case FocusIn:
+            if (event.xfocus.detail != NotifyPointer)
+            {
+                mIsOwnWindowFocused = true;
+            }
+            break;
+        case FocusOut:
+            if (event.xfocus.detail != NotifyPointer && event.xfocus.detail != NotifyInferior)
+            {
+                mIsOwnWindowFocused = false;
+            }
+            break;
+        case GenericEvent:
+            if (event.xcookie.extension == mXiOpcode && XGetEventData(mDisplay, &event.xcookie))
+            {
+                // Our own injected events are already accounted for
+                const XIRawEvent *raw = static_cast<const XIRawEvent*>(event.xcookie.data);
+                if (!isXTestDevice(raw->sourceid))
+                {
+                    switch (event.xcookie.evtype)
+                    {
+                    case XI_RawMotion:
+                        // Moved by the user, query where to in prepare
+                        mIsPointerDirty = true;
+                        break;
+                    case XI_RawKeyPress:
+                        setKeyDown(raw->detail, true);
+                        break;
+                    case XI_RawKeyRelease:
+                        setKeyDown(raw->detail, false);
+                        break;
+                    default:
+                        break;
+                    }
+                }
+                XFreeEventData(mDisplay, &event.xcookie);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    if (isKeymapChanged)
+    {
+        refreshKeymap();
+    }
+}
+
+
+bool XlibBackend::prepare()
+{
+    if (mDisplay == NULL)
+    {
+        return false;
+    }
+
+    processEvents();
+    if (mXiOpcode < 0)
+    {
+        // Without XInput2 nothing reports key presses, held modifiers are queried for every batch
+        char keys[32];
+        XQueryKeymap(mDisplay, keys);
+        for (int code = 0; code < 256; ++code)
+        {
+            setKeyDown(code, (keys[code / 8] & (1 << (code % 8))) != 0);
+        }
+    }
+
+    if (mIsPointerDirty)
+    {
+        Window root;
+        Window child;
+        int x;
+        int y;
+        int rootX;
+        int rootY;
+        unsigned int state;
+        XQueryPointer(mDisplay, DefaultRootWindow(mDisplay), &root, &child, &rootX, &rootY, &x, &y, &state);
+        mPointer = QPoint(rootX, rootY);
+
+        // Without XInput2 the pointer is queried for every batch
+        mIsPointerDirty = mXiOpcode < 0;
+    }
+    return true;
+}
+
+
+QRect XlibBackend::ownWindow()
+{
+    if (mIsWindowDirty && mParentWindow != 0)
+    {
+        XWindowAttributes attributes;
+        if (XGetWindowAttributes(mDisplay, mParentWindow, &attributes))
+        {
+            int x;
+            int y;
+            Window child;
+            XTranslateCoordinates(mDisplay, mParentWindow, attributes.root, 0, 0, &x, &y, &child);
+            mOwnWindow = QRect(x, y, attributes.width, attributes.height);
+        }
+        mIsWindowDirty = false;
+    }
+    return mOwnWindow;
+}
+
+
+void XlibBackend::fakeMotion(const QPoint &position, unsigned long delay)
+{
+    XTestFakeMotionEvent(mDisplay, 0, position.x(), position.y(), delay);
+}
+
+
+void XlibBackend::fakeButton(quint32 button, bool isPress, unsigned long delay)
+{
+    XTestFakeButtonEvent(mDisplay, button, isPress ? True : False, delay);
+}
+
+
+void XlibBackend::fakeKey(quint8 keyCode, bool isPress, unsigned long delay)
+{
+    XTestFakeKeyEvent(mDisplay, keyCode, isPress ? True : False, delay);
+}
+
+
+void XlibBackend::flush()
+{
+    XFlush(mDisplay);
+}
+
+
+bool XlibBackend::bindKey(quint8 keyCode, quint32 keySym)
+{
+    // Both levels, so the shift state does not matter
+    KeySym syms[2] = { keySym, keySym };
+    XChangeKeyboardMapping(mDisplay, keyCode, 2, syms, 1);
+    return true;
+}
+
+
+void XlibBackend::startTracking()
+{
+    // Raw events are reported on the root window regardless of grabs and focus
+    int event;
+    int error;
+    int major = 2;
+    int minor = 0;
+    if (XQueryExtension(mDisplay, "XInputExtension", &mXiOpcode, &event, &error)
+        && XIQueryVersion(mDisplay, &major, &minor) == Success)
+    {
+        unsigned char mask[XIMaskLen(XI_LASTEVENT)];
+        memset(mask, 0x00, sizeof(mask));
+        XISetMask(mask, XI_RawMotion);
+        XISetMask(mask, XI_RawKeyPress);
+        XISetMask(mask, XI_RawKeyRelease);
+        XIEventMask eventMask;
+        eventMask.deviceid = XIAllMasterDevices;
+        eventMask.mask_len = sizeof(mask);
+        eventMask.mask = mask;
+        XISelectEvents(mDisplay, DefaultRootWindow(mDisplay), &eventMask, 1);
+
+        // Our own injected events come from the XTEST slave devices
+        int deviceCount;
+        XIDeviceInfo *devices = XIQueryDevice(mDisplay, XIAllDevices, &deviceCount);
+        for (int i = 0; i < deviceCount; ++i)
+        {
+            if (strstr(devices[i].name, "XTEST") != NULL && mXTestDeviceCount < MaxXTestDevices)
+            {
+                mXTestDevices[mXTestDeviceCount++] = devices[i].deviceid;
+            }
+        }
+        XIFreeDeviceInfo(devices);
+    }
+    else
+    {
+        mXiOpcode = -1;
+    }
+
+    // Initial state, kept up to date from events from here on
+    char keys[32];
+    XQueryKeymap(mDisplay, keys);
+    for (int code = 0; code < 256; ++code)
+    {
+        setKeyDown(code, (keys[code / 8] & (1 << (code % 8))) != 0);
+    }
+    if (mParentWindow != 0)
+    {
+        XSelectInput(mDisplay, mParentWindow, StructureNotifyMask | FocusChangeMask);
+        Window focusWindow;
+        int revert;
+        XGetInputFocus(mDisplay, &focusWindow, &revert);
+        mIsOwnWindowFocused = focusWindow == mParentWindow;
+    }
+}
+
+
+void XlibBackend::refreshKeymap()
+{
+    int minCode;
+    int maxCode;
+    int symsPerCode;
+    XDisplayKeycodes(mDisplay, &minCode, &maxCode);
+    KeySym *syms = XGetKeyboardMapping(mDisplay, minCode, maxCode - minCode + 1, &symsPerCode);
+    if (syms != NULL)
+    {
+        // KeySym is a long, the shared table takes 32 bit keysyms
+        std::vector<quint32> keySyms(syms, syms + (maxCode - minCode + 1) * symsPerCode);
+        setKeyboardMapping(keySyms.data(), minCode, maxCode, symsPerCode);
+        XFree(syms);
+    }
+}
+
+
+bool XlibBackend::isXTestDevice(int deviceId) const
+{
+    for (int i = 0; i < mXTestDeviceCount; ++i)
+    {
+        if (mXTestDevices[i] == deviceId)
+        {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,53 @@
+#ifndef XLIBBACKEND_HPP
+#define XLIBBACKEND_HPP
+
+#include "MouseRobotBackend.hpp"
+struct _XDisplay;
+
+
+// Xlib + XTest backend. Pointer motion and modifier keys are followed
+// through XInput2 raw events, so only user motion causes a pointer query.
+class XlibBackend : public MouseRobotBackend
+{
+public:
+    XlibBackend();
+    ~XlibBackend();
+
+public:
+    const char *name() const;
+    bool open(quintptr parentWindow);
+    void close();
+    void processEvents();
+
+protected:
+    bool prepare();
+    QRect ownWindow();
+    void fakeMotion(const QPoint &position, unsigned long delay);
+    void fakeButton(quint32 button, bool isPress, unsigned long delay);
+    void fakeKey(quint8 keyCode, bool isPress, unsigned long delay);
+    void flush();
+    bool bindKey(quint8 keyCode, quint32 keySym);
+
+private:
+    void startTracking();
+    void refreshKeymap();
+    bool isXTestDevice(int deviceId) const;
+
+private:
+    // Usually one XTEST pointer and one XTEST keyboard
+    enum
+    {
+        MaxXTestDevices = 4
+    };
+
+    _XDisplay *mDisplay;
+    quintptr mParentWindow;
+    int mXiOpcode;
+    int mXTestDevices[MaxXTestDevices];
+    int mXTestDeviceCount;
+    bool mIsPointerDirty;
+    QRect mOwnWindow;
+    bool mIsWindowDirty;
+};
+
+#endif // XLIBBACKEND_HPP
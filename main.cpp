@@ -1,17 +1,35 @@
 #include "MainWindow.hpp"
 #include "GlassWindow.hpp"
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QDialog>
 
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    ThreadSettings::addOptions(parser);
+    parser.addPositionalArgument("file", "Rule file to restore at startup and autosave to.", "[file]");
+    parser.process(a);
+
+    // Command line first, then AUTOCLICK_RULES, then the config directory
+    QString fileName = QString::fromLocal8Bit(qgetenv("AUTOCLICK_RULES"));
+    if (!parser.positionalArguments().isEmpty())
+    {
+        fileName = parser.positionalArguments().first();
+    }
+    if (fileName.isEmpty())
+    {
+        fileName = RuleJournal::defaultFileName();
+    }
 
     GlassWindow glass;
     glass.show();
 
-    MainWindow window(&glass, &glass);
+    MainWindow window(&glass, &glass, fileName);
+    window.setThreadSettings(ThreadSettings::fromOptions(parser));
     window.show();
 
     return a.exec();
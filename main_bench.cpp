@@ -0,0 +1,493 @@
+#include "GlassWindow.hpp"
+#include "MouseRobot.hpp"
+#include "MouseRobotBackend.hpp"
+#include "MouseRuleConfig.hpp"
+#include "MouseRuleOverlay.hpp"
+#include "NullBackend.hpp"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QTemporaryDir>
+#include <QtTest>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <vector>
+
+
+namespace
+{
+const int RuleCounts[] = { 10, 100, 1000, 10000 };
+// Rule files are expected to load 100,000 rules well within a second
+const int FileRuleCounts[] = { 10, 100, 1000, 10000, 100000 };
+// Least time spent on a benchmark measured by measure() (ns)
+const qint64 MinTime = 500000000ll;
+// Rules invoked per submit, their commands always fit into the robot's queue
+const int ChunkRules = MouseRobot::MaxQueuedCommands / 4;
+
+
+enum RobotCall
+{
+    ClickCall,
+    KeyCall,
+    MoveCall,
+    BatchCall
+};
+
+
+void addRuleCounts(const int *counts, size_t size)
+{
+    QTest::addColumn<int>("rules");
+    for (size_t i = 0; i < size; ++i)
+    {
+        QTest::newRow(QByteArray::number(counts[i]).constData()) << counts[i];
+    }
+}
+
+
+// Runs rounds for at least MinTime and reports the median ns per op, which
+// is robust against scheduler noise. A round returns the ns it measured, so
+// it can leave out waiting for the robot.
+void measure(qint64 opsPerRound, const std::function<qint64()> &round)
+{
+    // Warm up caches and lazily built state
+    round();
+
+    std::vector<double> rounds;
+    QElapsedTimer total;
+    total.start();
+    while (total.nsecsElapsed() < MinTime || rounds.size() < 5)
+    {
+        rounds.push_back(static_cast<double>(round()) / opsPerRound);
+    }
+    std::sort(rounds.begin(), rounds.end());
+    QTest::setBenchmarkResult(rounds[rounds.size() / 2], QTest::WalltimeNanoseconds);
+}
+
+
+// Invokes count times in chunks that fit into the robot's queue. The robot
+// drains in between, untimed, so nothing is dropped. Returns the ns spent
+// invoking and submitting.
+template <typename Invoke>
+qint64 invokeChunked(MouseRobot &robot, int count, Invoke invoke)
+{
+    qint64 elapsed = 0;
+    for (int first = 0; first < count; first += ChunkRules)
+    {
+        int last = std::min(count, first + ChunkRules);
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = first; i < last; ++i)
+        {
+            invoke(i);
+        }
+        robot.submit();
+        elapsed += timer.nsecsElapsed();
+        robot.waitUntilIdle();
+    }
+    return elapsed;
+}
+
+
+MouseRuleData makeRule(int i)
+{
+    // Mix of every mode, like a real config
+    MouseRuleData rule;
+    rule.positionMode = static_cast<EPositionMode>(i % 3);
+    rule.position = rule.positionMode == AbsolutePosition ? QPoint(100 + (i * 37) % 1600, 100 + (i * 53) % 800)
+                                                          : QPoint((i % 7) - 3, (i % 5) - 2);
+    rule.interval = 1000000ll * (1 + i % 100);
+    rule.actionMode = static_cast<EActionMode>(i % 3);
+    rule.action = rule.actionMode == KeyAction ? static_cast<quint32>(Qt::Key_A + i % 26) : 1 + i % 3;
+    return rule;
+}
+
+
+void fillConfig(MouseRuleConfig &config, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        config.addRule(makeRule(i));
+    }
+}
+
+
+// Moves jump, so the null backend drains the queue at once
+void makeTeleport(MouseRobot &robot)
+{
+    robot.setMotion(MouseRobot::Motion(MouseRobot::TeleportMotion));
+}
+
+
+// One overlay of count rules on a full screen glass window
+struct OverlayFixture
+{
+    OverlayFixture(int count, const QSize &size)
+        : glass()
+        , config()
+        , overlay(config)
+    {
+        glass.setGeometry(0, 0, size.width(), size.height());
+        config.addObserver(&overlay);
+        overlay.setOrigin(QPoint(size.width() / 2, size.height() / 2));
+        fillConfig(config, count);
+        glass.addDrawable(&overlay);
+    }
+
+    ~OverlayFixture()
+    {
+        glass.removeDrawable(&overlay);
+    }
+
+    GlassWindow glass;
+    MouseRuleConfig config;
+    MouseRuleOverlay overlay;
+};
+}
+
+
+// Engine, injection submission, rule file and overlay painting benchmarks
+class AutoClickBench : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void invoke_compiled_data();
+    void invoke_compiled();
+    void invoke_uncompiled_data();
+    void invoke_uncompiled();
+    void robot_data();
+    void robot();
+    void inject_data();
+    void inject();
+    void config_save_data();
+    void config_save();
+    void config_load_data();
+    void config_load();
+    void config_save_binary_data();
+    void config_save_binary();
+    void config_load_binary_data();
+    void config_load_binary();
+    void overlay_paint_full_data();
+    void overlay_paint_full();
+    void overlay_paint_damage_data();
+    void overlay_paint_damage();
+    void overlay_paint_drawables();
+
+private:
+    void benchSave(const QString &fileName);
+    void benchLoad(const QString &fileName);
+};
+
+
+void AutoClickBench::invoke_compiled_data()
+{
+    addRuleCounts(RuleCounts, sizeof(RuleCounts) / sizeof(RuleCounts[0]));
+}
+
+
+void AutoClickBench::invoke_compiled()
+{
+    QFETCH(int, rules);
+    MouseRobot robot(0, new NullBackend());
+    makeTeleport(robot);
+    MouseRuleConfig config;
+    fillConfig(config, rules);
+
+    // As the scheduler does: compiled once, fired many times
+    std::vector<MouseRuleAction> actions;
+    for (int i = 0; i < config.rules().size(); ++i)
+    {
+        actions.push_back(MouseRuleAction(config.rules()[i]));
+    }
+    bool isQueued = true;
+    measure(rules, [&]()
+    {
+        return invokeChunked(robot, rules, [&](int i)
+        {
+            isQueued = actions[i].invoke(robot) && isQueued;
+        });
+    });
+    QVERIFY2(isQueued, "the robot dropped commands");
+}
+
+
+void AutoClickBench::invoke_uncompiled_data()
+{
+    addRuleCounts(RuleCounts, sizeof(RuleCounts) / sizeof(RuleCounts[0]));
+}
+
+
+void AutoClickBench::invoke_uncompiled()
+{
+    QFETCH(int, rules);
+    MouseRobot robot(0, new NullBackend());
+    makeTeleport(robot);
+    MouseRuleConfig config;
+    fillConfig(config, rules);
+
+    const MouseRules &data = config.rules();
+    bool isQueued = true;
+    measure(rules, [&]()
+    {
+        return invokeChunked(robot, rules, [&](int i)
+        {
+            isQueued = data[i].invoke(robot) && isQueued;
+        });
+    });
+    QVERIFY2(isQueued, "the robot dropped commands");
+}
+
+
+void AutoClickBench::robot_data()
+{
+    QTest::addColumn<int>("call");
+    QTest::newRow("click") << static_cast<int>(ClickCall);
+    QTest::newRow("key") << static_cast<int>(KeyCall);
+    QTest::newRow("move") << static_cast<int>(MoveCall);
+    QTest::newRow("batch_64") << static_cast<int>(BatchCall);
+}
+
+
+void AutoClickBench::robot()
+{
+    // Submission cost on the calling thread, the null backend drains the queue
+    QFETCH(int, call);
+    const int ops = 256;
+    MouseRobot robot(0, new NullBackend());
+    makeTeleport(robot);
+    MouseRobot::KeyStroke stroke = MouseRobot::compileKey(Qt::ControlModifier | Qt::Key_C);
+    bool isQueued = true;
+    measure(ops, [&]()
+    {
+        return invokeChunked(robot, ops, [&](int i)
+        {
+            switch (call)
+            {
+            case ClickCall:
+                isQueued = robot.mouseClick(MouseRobot::Button1) && isQueued;
+                robot.submit();
+                break;
+            case KeyCall:
+                isQueued = robot.keyType(stroke) && isQueued;
+                robot.submit();
+                break;
+            case MoveCall:
+                isQueued = robot.mouseMove(i, i) && isQueued;
+                robot.submit();
+                break;
+            case BatchCall:
+                isQueued = robot.mouseMoveBy(1, 0) && robot.mouseClick(MouseRobot::Button1) && isQueued;
+                if (i % 64 == 63)
+                {
+                    robot.submit();
+                }
+                break;
+            }
+        });
+    });
+    QVERIFY2(isQueued, "the robot dropped commands");
+}
+
+
+void AutoClickBench::inject_data()
+{
+    QTest::addColumn<QString>("backend");
+    QTest::addColumn<int>("commands");
+    QTest::addColumn<int>("ops");
+    // One rule per tick (move and click), and the cost per event of a large batch
+    QTest::newRow("xlib_tick") << QString("xlib") << 2 << 1;
+    QTest::newRow("xlib_batch_64") << QString("xlib") << 64 << 64;
+    QTest::newRow("xcb_tick") << QString("xcb") << 2 << 1;
+    QTest::newRow("xcb_batch_64") << QString("xcb") << 64 << 64;
+}
+
+
+void AutoClickBench::inject()
+{
+    // Time on the injection thread until the events are flushed to the server.
+    // It moves and clicks for real, so it only runs on request, e.g. under Xvfb.
+    if (qgetenv("AUTOCLICK_BENCH_INJECT").isEmpty())
+    {
+        QSKIP("Set AUTOCLICK_BENCH_INJECT=1 to inject into the X server in $DISPLAY");
+    }
+    QFETCH(QString, backend);
+    QFETCH(int, commands);
+    QFETCH(int, ops);
+    std::unique_ptr<MouseRobotBackend> injector(MouseRobotBackend::create(backend));
+    if (!injector->open(0))
+    {
+        QSKIP("Cannot open the backend");
+    }
+    std::vector<MouseRobotBackend::Command> batch(commands);
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+        MouseRobotBackend::Command &command = batch[i];
+        command.type = i % 2 == 0 ? MouseRobotBackend::Command::Move : MouseRobotBackend::Command::Click;
+        command.x = 100 + static_cast<qint32>(i);
+        command.y = 100;
+        command.value = MouseRobot::Button1;
+    }
+    measure(ops, [&]()
+    {
+        QElapsedTimer timer;
+        timer.start();
+        injector->execute(batch);
+        return timer.nsecsElapsed();
+    });
+    injector->close();
+}
+
+
+void AutoClickBench::config_save_data()
+{
+    addRuleCounts(FileRuleCounts, sizeof(FileRuleCounts) / sizeof(FileRuleCounts[0]));
+}
+
+
+void AutoClickBench::config_save()
+{
+    QTemporaryDir dir;
+    benchSave(QDir(dir.path()).filePath("rules.ini"));
+}
+
+
+void AutoClickBench::config_load_data()
+{
+    addRuleCounts(FileRuleCounts, sizeof(FileRuleCounts) / sizeof(FileRuleCounts[0]));
+}
+
+
+void AutoClickBench::config_load()
+{
+    QTemporaryDir dir;
+    benchLoad(QDir(dir.path()).filePath("rules.ini"));
+}
+
+
+void AutoClickBench::config_save_binary_data()
+{
+    addRuleCounts(FileRuleCounts, sizeof(FileRuleCounts) / sizeof(FileRuleCounts[0]));
+}
+
+
+void AutoClickBench::config_save_binary()
+{
+    QTemporaryDir dir;
+    benchSave(QDir(dir.path()).filePath("rules.acr"));
+}
+
+
+void AutoClickBench::config_load_binary_data()
+{
+    addRuleCounts(FileRuleCounts, sizeof(FileRuleCounts) / sizeof(FileRuleCounts[0]));
+}
+
+
+void AutoClickBench::config_load_binary()
+{
+    QTemporaryDir dir;
+    benchLoad(QDir(dir.path()).filePath("rules.acr"));
+}
+
+
+void AutoClickBench::benchSave(const QString &fileName)
+{
+    QFETCH(int, rules);
+    MouseRuleConfig config;
+    fillConfig(config, rules);
+    QBENCHMARK
+    {
+        config.save(fileName);
+    }
+}
+
+
+void AutoClickBench::benchLoad(const QString &fileName)
+{
+    QFETCH(int, rules);
+    MouseRuleConfig config;
+    fillConfig(config, rules);
+    config.save(fileName);
+    MouseRuleConfig loaded;
+    QBENCHMARK
+    {
+        loaded.load(fileName);
+    }
+    QCOMPARE(loaded.rules().size(), rules);
+}
+
+
+void AutoClickBench::overlay_paint_full_data()
+{
+    addRuleCounts(RuleCounts, sizeof(RuleCounts) / sizeof(RuleCounts[0]));
+}
+
+
+void AutoClickBench::overlay_paint_full()
+{
+    QFETCH(int, rules);
+    QImage target(1920, 1080, QImage::Format_ARGB32_Premultiplied);
+    OverlayFixture fixture(rules, target.size());
+    QBENCHMARK
+    {
+        target.fill(Qt::transparent);
+        fixture.glass.render(&target, QPoint(), QRegion(target.rect()));
+    }
+}
+
+
+void AutoClickBench::overlay_paint_damage_data()
+{
+    addRuleCounts(RuleCounts, sizeof(RuleCounts) / sizeof(RuleCounts[0]));
+}
+
+
+void AutoClickBench::overlay_paint_damage()
+{
+    QFETCH(int, rules);
+    QImage target(1920, 1080, QImage::Format_ARGB32_Premultiplied);
+    target.fill(Qt::transparent);
+    OverlayFixture fixture(rules, target.size());
+    QBENCHMARK
+    {
+        // What a single moved marker repaints
+        fixture.glass.render(&target, QPoint(), QRegion(900, 500, 64, 64));
+    }
+}
+
+
+void AutoClickBench::overlay_paint_drawables()
+{
+    // Many drawables of a few rules each
+    QImage target(1920, 1080, QImage::Format_ARGB32_Premultiplied);
+    GlassWindow glass;
+    glass.setGeometry(0, 0, target.width(), target.height());
+    std::vector<MouseRuleConfig*> configs;
+    std::vector<MouseRuleOverlay*> overlays;
+    for (int i = 0; i < 100; ++i)
+    {
+        configs.push_back(new MouseRuleConfig());
+        overlays.push_back(new MouseRuleOverlay(*configs.back()));
+        configs.back()->addObserver(overlays.back());
+        overlays.back()->setOrigin(QPoint(20 + (i % 10) * 180, 20 + (i / 10) * 100));
+        fillConfig(*configs.back(), 10);
+        glass.addDrawable(overlays.back());
+    }
+    QBENCHMARK
+    {
+        target.fill(Qt::transparent);
+        glass.render(&target, QPoint(), QRegion(target.rect()));
+    }
+    glass.removeAllDrawables();
+    for (size_t i = 0; i < overlays.size(); ++i)
+    {
+        delete overlays[i];
+        delete configs[i];
+    }
+}
+
+
+QTEST_MAIN(AutoClickBench)
+
+#include "main_bench.moc"
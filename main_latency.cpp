@@ -0,0 +1,432 @@
+#include "MouseRobot.hpp"
+#include "MouseRobotBackend.hpp"
+#include "MouseRuleConfig.hpp"
+#include "RuleScheduler.hpp"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QProcess>
+#include <QThread>
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+#include <poll.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <deque>
+#include <vector>
+#include <cstdio>
+
+
+namespace
+{
+// Rules beyond the first three type keys starting at 'a'
+const int ButtonRules = 3;
+const int MaxRules = ButtonRules + 26;
+
+
+// Private X server on the first free display number
+class XvfbServer
+{
+public:
+    XvfbServer()
+        : mProcess()
+        , mDisplay()
+    {
+    }
+
+    ~XvfbServer()
+    {
+        stop();
+    }
+
+    bool start(const QString &program)
+    {
+        for (int number = 90; number < 200; ++number)
+        {
+            if (QFileInfo(QString("/tmp/.X%1-lock").arg(number)).exists())
+            {
+                continue;
+            }
+            mDisplay = QString(":%1").arg(number);
+            mProcess.start(program, QStringList() << mDisplay << "-screen" << "0" << "1280x1024x24" << "-nolisten" << "tcp");
+            if (!mProcess.waitForStarted())
+            {
+                return false;
+            }
+
+            // Ready once a client can connect
+            for (int i = 0; i < 100 && mProcess.state() == QProcess::Running; ++i)
+            {
+                Display *display = XOpenDisplay(mDisplay.toLocal8Bit().constData());
+                if (display != NULL)
+                {
+                    XCloseDisplay(display);
+                    return true;
+                }
+                QThread::msleep(50);
+            }
+            stop();
+        }
+        return false;
+    }
+
+    void stop()
+    {
+        if (mProcess.state() != QProcess::NotRunning)
+        {
+            mProcess.terminate();
+            mProcess.waitForFinished();
+        }
+    }
+
+    const QString &display() const
+    {
+        return mDisplay;
+    }
+
+private:
+    QProcess mProcess;
+    QString mDisplay;
+};
+
+
+// Full screen window on its own connection, stamps every button and key press on arrival
+class ProbeClient : public QThread
+{
+public:
+    struct Event
+    {
+        bool isKey;
+        int detail;
+        qint64 time;
+    };
+
+public:
+    ProbeClient()
+        : QThread()
+        , mDisplay(NULL)
+        , mWindow(0)
+        , mMutex()
+        , mEvents()
+        , mIsStopping(false)
+    {
+    }
+
+    ~ProbeClient()
+    {
+        stop();
+        if (mDisplay != NULL)
+        {
+            XCloseDisplay(mDisplay);
+            mDisplay = NULL;
+        }
+    }
+
+    bool open()
+    {
+        mDisplay = XOpenDisplay(NULL);
+        if (mDisplay == NULL)
+        {
+            return false;
+        }
+        int screen = DefaultScreen(mDisplay);
+        XSetWindowAttributes attributes;
+        attributes.override_redirect = True;
+        attributes.event_mask = ButtonPressMask | KeyPressMask | StructureNotifyMask;
+        mWindow = XCreateWindow(mDisplay, RootWindow(mDisplay, screen), 0, 0,
+                                DisplayWidth(mDisplay, screen), DisplayHeight(mDisplay, screen), 0,
+                                CopyFromParent, InputOutput, CopyFromParent,
+                                CWOverrideRedirect | CWEventMask, &attributes);
+        XMapRaised(mDisplay, mWindow);
+        XEvent event;
+        XWindowEvent(mDisplay, mWindow, StructureNotifyMask, &event);
+        XSetInputFocus(mDisplay, mWindow, RevertToParent, CurrentTime);
+        XSync(mDisplay, False);
+        return true;
+    }
+
+    // Only before start(), the thread owns the connection from then on
+    int keyCode(KeySym keySym) const
+    {
+        return XKeysymToKeycode(mDisplay, keySym);
+    }
+
+    void stop()
+    {
+        mIsStopping = true;
+        wait();
+    }
+
+    std::vector<Event> events() const
+    {
+        QMutexLocker locker(&mMutex);
+        return mEvents;
+    }
+
+protected:
+    void run()
+    {
+        pollfd fd;
+        fd.fd = ConnectionNumber(mDisplay);
+        fd.events = POLLIN;
+        while (!mIsStopping)
+        {
+            if (XPending(mDisplay) == 0)
+            {
+                poll(&fd, 1, 100);
+                continue;
+            }
+            XEvent event;
+            XNextEvent(mDisplay, &event);
+            qint64 time = RuleScheduler::now();
+            if (event.type == ButtonPress || event.type == KeyPress)
+            {
+                Event e;
+                e.isKey = event.type == KeyPress;
+                e.detail = e.isKey ? event.xkey.keycode : event.xbutton.button;
+                e.time = time;
+                QMutexLocker locker(&mMutex);
+                mEvents.push_back(e);
+            }
+        }
+    }
+
+private:
+    Display *mDisplay;
+    Window mWindow;
+    mutable QMutex mMutex;
+    std::vector<Event> mEvents;
+    std::atomic<bool> mIsStopping;
+};
+
+
+class FireLog : public RuleFireObserver
+{
+public:
+    struct Fire
+    {
+        qint64 deadline;
+        qint64 time;
+    };
+
+public:
+    explicit FireLog(int ruleCount)
+        : mMutex()
+        , mFires(ruleCount)
+    {
+    }
+
+    void ruleFired(int index, qint64 deadline, qint64 time)
+    {
+        Fire fire;
+        fire.deadline = deadline;
+        fire.time = time;
+        QMutexLocker locker(&mMutex);
+        mFires[index].push_back(fire);
+    }
+
+    std::vector<std::deque<Fire> > fires() const
+    {
+        QMutexLocker locker(&mMutex);
+        return mFires;
+    }
+
+private:
+    mutable QMutex mMutex;
+    std::vector<std::deque<Fire> > mFires;
+};
+
+
+double percentile(std::vector<qint64> values, double p)
+{
+    if (values.empty())
+    {
+        return 0.0;
+    }
+    size_t n = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + n, values.end());
+    return values[n] / 1000.0;
+}
+
+
+QJsonObject statistics(const std::vector<qint64> &values)
+{
+    // All in microseconds, jitter is the standard deviation
+    double mean = 0.0;
+    for (auto v = values.begin(); v != values.end(); ++v)
+    {
+        mean += *v / 1000.0;
+    }
+    mean /= std::max<size_t>(values.size(), 1);
+    double variance = 0.0;
+    for (auto v = values.begin(); v != values.end(); ++v)
+    {
+        variance += (*v / 1000.0 - mean) * (*v / 1000.0 - mean);
+    }
+    variance /= std::max<size_t>(values.size(), 1);
+
+    QJsonObject result;
+    result["count"] = static_cast<int>(values.size());
+    result["p50"] = percentile(values, 0.50);
+    result["p99"] = percentile(values, 0.99);
+    result["max"] = values.empty() ? 0.0 : *std::max_element(values.begin(), values.end()) / 1000.0;
+    result["mean"] = mean;
+    result["jitter"] = std::sqrt(variance);
+    return result;
+}
+}
+
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures the time from a rule's deadline until a probe window receives "
+                                     "its ButtonPress/KeyPress, on a private Xvfb.");
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("backend", "Injection backend (xlib, xcb).", "name", "xlib"));
+    parser.addOption(QCommandLineOption("rules", "Number of rules (1-29); three click, the rest type keys.", "count", "6"));
+    parser.addOption(QCommandLineOption("interval", "Interval of the first rule in ms, each further rule adds 7 ms.", "ms", "20"));
+    parser.addOption(QCommandLineOption("precise", "Mark the rules as microsecond rules, so the scheduler spins before each deadline."));
+    parser.addOption(QCommandLineOption("duration", "Measuring time in s.", "s", "10"));
+    parser.addOption(QCommandLineOption("xvfb", "X server to launch.", "program", "Xvfb"));
+    parser.addOption(QCommandLineOption("display", "Use this running X server instead of launching one.", "name"));
+    parser.addOption(QCommandLineOption("output", "Also write the results as JSON to <file>.", "file"));
+    parser.process(a);
+
+    int ruleCount = std::max(1, std::min(parser.value("rules").toInt(), MaxRules));
+    qint64 interval = parser.value("interval").toLongLong() * 1000000ll;
+
+    XvfbServer server;
+    if (parser.isSet("display"))
+    {
+        qputenv("DISPLAY", parser.value("display").toLocal8Bit());
+    }
+    else
+    {
+        if (!server.start(parser.value("xvfb")))
+        {
+            fprintf(stderr, "Cannot start %s\n", parser.value("xvfb").toLocal8Bit().constData());
+            return 1;
+        }
+        qputenv("DISPLAY", server.display().toLocal8Bit());
+    }
+
+    ProbeClient probe;
+    if (!probe.open())
+    {
+        fprintf(stderr, "Cannot open display %s\n", qgetenv("DISPLAY").constData());
+        return 1;
+    }
+
+    // Rules identify themselves by button or by key. Keycodes are looked up
+    // before the probe thread takes over the connection.
+    std::vector<int> ruleOfButton(6, -1);
+    std::vector<int> ruleOfKey(256, -1);
+    for (int i = ButtonRules; i < ruleCount; ++i)
+    {
+        ruleOfKey[probe.keyCode(XK_a + (i - ButtonRules)) & 0xff] = i;
+    }
+    probe.start();
+
+    FireLog fireLog(ruleCount);
+    {
+        MouseRobot robot(0, MouseRobotBackend::create(parser.value("backend")));
+        RuleScheduler scheduler(&robot);
+        MouseRuleConfig config(&scheduler);
+        for (int i = 0; i < ruleCount; ++i)
+        {
+            MouseRuleData rule;
+            rule.interval = interval + i * 7000000ll;
+            rule.intervalMode = parser.isSet("precise") ? MicrosecondsInterval : MillisecondsInterval;
+            if (i < ButtonRules)
+            {
+                rule.actionMode = ButtonAction;
+                rule.action = 1 + i;
+                ruleOfButton[rule.action] = i;
+            }
+            else
+            {
+                rule.actionMode = KeyAction;
+                rule.action = Qt::Key_A + (i - ButtonRules);
+            }
+            config.addRule(rule);
+        }
+        scheduler.setFireObserver(&fireLog);
+
+        scheduler.setActive(true);
+        QThread::msleep(parser.value("duration").toULong() * 1000);
+        scheduler.setActive(false);
+
+        // Let the last events arrive
+        QThread::msleep(500);
+    }
+    probe.stop();
+
+    // The n-th event of a rule belongs to its n-th fire
+    std::vector<std::deque<FireLog::Fire> > fires = fireLog.fires();
+    std::vector<std::vector<qint64> > latencies(ruleCount);
+    std::vector<std::vector<qint64> > delays(ruleCount);
+    std::vector<int> lost(ruleCount, 0);
+    std::vector<ProbeClient::Event> events = probe.events();
+    for (auto e = events.begin(); e != events.end(); ++e)
+    {
+        int rule = e->isKey ? ruleOfKey[e->detail & 0xff] : (e->detail < 6 ? ruleOfButton[e->detail] : -1);
+        if (rule < 0 || fires[rule].empty())
+        {
+            continue;
+        }
+        const FireLog::Fire &fire = fires[rule].front();
+        latencies[rule].push_back(e->time - fire.deadline);
+        delays[rule].push_back(fire.time - fire.deadline);
+        fires[rule].pop_front();
+    }
+
+    QJsonArray results;
+    std::vector<qint64> all;
+    printf("rule  interval    count      p50 us      p99 us      max us   jitter us   sched p99 us  lost\n");
+    for (int i = 0; i < ruleCount; ++i)
+    {
+        lost[i] = static_cast<int>(fires[i].size());
+        QJsonObject total = statistics(latencies[i]);
+        QJsonObject sched = statistics(delays[i]);
+        printf("%4d  %6lld ms  %7d  %10.1f  %10.1f  %10.1f  %10.1f  %13.1f  %4d\n",
+               i + 1, (interval + i * 7000000ll) / 1000000ll, total["count"].toInt(),
+               total["p50"].toDouble(), total["p99"].toDouble(), total["max"].toDouble(),
+               total["jitter"].toDouble(), sched["p99"].toDouble(), lost[i]);
+
+        QJsonObject result;
+        result["rule"] = i + 1;
+        result["interval_ms"] = static_cast<double>((interval + i * 7000000ll) / 1000000ll);
+        result["latency_us"] = total;
+        result["scheduling_us"] = sched;
+        result["lost"] = lost[i];
+        results.append(result);
+        all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+    }
+    QJsonObject overall = statistics(all);
+    printf(" all                       %7d  %10.1f  %10.1f  %10.1f  %10.1f\n", overall["count"].toInt(),
+           overall["p50"].toDouble(), overall["p99"].toDouble(), overall["max"].toDouble(), overall["jitter"].toDouble());
+
+    if (parser.isSet("output"))
+    {
+        QJsonObject report;
+        report["backend"] = parser.value("backend");
+        report["rules"] = results;
+        report["latency_us"] = overall;
+        QFile file(parser.value("output"));
+        if (!file.open(QIODevice::WriteOnly))
+        {
+            fprintf(stderr, "Cannot write '%s'\n", parser.value("output").toLocal8Bit().constData());
+            return 1;
+        }
+        file.write(QJsonDocument(report).toJson());
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include "MouseRobot.hpp"
+#include "MouseRobotBackend.hpp"
+#include "MouseRuleConfig.hpp"
+#include "RuleFileWatcher.hpp"
+#include "RuleScheduler.hpp"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFileInfo>
+#include <QSocketNotifier>
+#include <QStringList>
+#include <sys/signalfd.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cstdio>
+
+
+int main(int argc, char *argv[])
+{
+    // Block termination signals before any thread starts, they are read from a signalfd instead
+    sigset_t blockedSignals;
+    sigemptyset(&blockedSignals);
+    sigaddset(&blockedSignals, SIGINT);
+    sigaddset(&blockedSignals, SIGTERM);
+    sigaddset(&blockedSignals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &blockedSignals, 0);
+
+    QCoreApplication a(argc, argv);
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("backend", "Injection backend (xlib, xcb, record, null).", "name",
+                                        QString::fromLocal8Bit(qgetenv("AUTOCLICK_BACKEND"))));
+    ThreadSettings::addOptions(parser);
+    parser.addOption(QCommandLineOption("histograms", "On exit, write the lateness histogram of every rule to <file>.", "file"));
+    parser.addOption(QCommandLineOption("watch", "Reload the rule file when it changes, keeping the timers of unchanged rules."));
+    parser.addOption(QCommandLineOption("convert", "Save the rules to <file> and exit instead of running them (*.acr is binary, else XML).", "file"));
+    parser.addPositionalArgument("file", "Rule file to run.");
+    parser.process(a);
+    QStringList args = parser.positionalArguments();
+    if (args.size() != 1)
+    {
+        parser.showHelp(1);
+    }
+    if (!QFileInfo(args[0]).isReadable())
+    {
+        fprintf(stderr, "Cannot read rule file '%s'\n", args[0].toLocal8Bit().constData());
+        return 1;
+    }
+
+    if (parser.isSet("convert"))
+    {
+        MouseRuleConfig config;
+        config.load(args[0]);
+        return config.save(parser.value("convert")) ? 0 : 1;
+    }
+
+    int signalFd = signalfd(-1, &blockedSignals, SFD_NONBLOCK | SFD_CLOEXEC);
+    QSocketNotifier signalNotifier(signalFd, QSocketNotifier::Read);
+    QObject::connect(&signalNotifier, &QSocketNotifier::activated, &a, &QCoreApplication::quit);
+
+    MouseRobot robot(0, MouseRobotBackend::create(parser.value("backend")));
+    RuleScheduler scheduler(&robot);
+    scheduler.setThreadSettings(ThreadSettings::fromOptions(parser));
+    MouseRuleConfig config(&scheduler);
+    config.load(args[0]);
+    RuleFileWatcher *watcher = parser.isSet("watch") ? new RuleFileWatcher(config, args[0]) : 0;
+
+    scheduler.setActive(true);
+    int result = a.exec();
+    scheduler.setActive(false);
+    delete watcher;
+    if (parser.isSet("histograms") && !scheduler.writeHistograms(parser.value("histograms")))
+    {
+        fprintf(stderr, "Cannot write '%s'\n", parser.value("histograms").toLocal8Bit().constData());
+    }
+
+    close(signalFd);
+    return result;
+}